@@ -0,0 +1,166 @@
+#include "utils.h"
+#include "arrival.h"
+#include <math.h>
+
+/*
+ * Passenger arrival processes of the generator in rejs. Each model hands out the gap to
+ * the next arrival; rejs keeps an absolute schedule on the monotonic clock, so time spent
+ * forking does not stretch the gaps.
+ *
+ *   burst                      as fast as fork() allows (the original behaviour)
+ *   constant:<rate>            evenly spaced, rate passengers per second
+ *   poisson:<rate>             exponentially distributed gaps with mean 1/rate
+ *   onoff:<rate>:<onMs>:<offMs> Poisson at rate for onMs, then nobody for offMs, repeated
+ *   replay:<path>              arrival times [ms from the start] read from a file,
+ *                              one per line
+ *
+ * The random models draw from their own rand_r() state, seeded with rejs -S.
+*/
+
+static double uniformOpen(ArrivalModel *model) {
+    // Uniform on (0, 1), never 0 so log() stays finite
+    return (rand_r(&model->randomState) + 1.0) / (RAND_MAX + 2.0);
+}
+
+
+static long long gapBurst(ArrivalModel *model) {
+    (void)model;
+    return 0;
+}
+
+
+static long long gapConstant(ArrivalModel *model) {
+    return (long long)(1e9 / model->rate);
+}
+
+
+static long long gapPoisson(ArrivalModel *model) {
+    return (long long)(-log(uniformOpen(model)) / model->rate * 1e9);
+}
+
+
+static long long gapOnOff(ArrivalModel *model) {
+/*
+  * Draws a Poisson gap counted in "on" time only: the off periods it crosses are added,
+  * so no arrival is ever scheduled while the dock is quiet.
+*/
+
+    long long onNs = model->onMs * 1000000LL, periodNs = onNs + model->offMs * 1000000LL;
+    long long gap = gapPoisson(model);
+    long long position = model->elapsedNs % periodNs, next = position;
+
+    while (gap > 0) {
+        long long onLeft = position < onNs ? onNs - position : 0;
+        if (gap < onLeft) {
+            next += gap;
+            break;
+        }
+        gap -= onLeft;
+        next += onLeft + (periodNs - (position + onLeft)); // Skip to the start of the next "on" period
+        position = 0;
+    }
+    return next - model->elapsedNs % periodNs;
+}
+
+
+static long long gapReplay(ArrivalModel *model) {
+    if (model->traceNext >= model->traceLength) {
+        return -1;
+    }
+    long long at = model->trace[model->traceNext++];
+    return at > model->elapsedNs ? at - model->elapsedNs : 0;
+}
+
+
+static int loadReplay(ArrivalModel *model, const char *path) {
+/*
+  * Reads the arrival times of a replay trace, sorted into ascending order.
+  *
+  * @return 1 on success, 0 if the file cannot be read or holds no arrivals.
+*/
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(RED "fopen arrival trace" RESET);
+        return 0;
+    }
+
+    model->trace = malloc(ARRIVAL_TRACE_MAX * sizeof(long long));
+    double ms;
+    while (model->trace != NULL && model->traceLength < ARRIVAL_TRACE_MAX && fscanf(file, "%lf", &ms) == 1) {
+        long long at = ms * 1000000LL;
+        int i = model->traceLength++;
+        while (i > 0 && model->trace[i - 1] > at) {
+            model->trace[i] = model->trace[i - 1];
+            i--;
+        }
+        model->trace[i] = at;
+    }
+    fclose(file);
+
+    if (model->traceLength == 0) {
+        return 0;
+    }
+    long long spanNs = model->trace[model->traceLength - 1] - model->trace[0];
+    model->requestedRate = spanNs > 0 ? (model->traceLength - 1) / (spanNs / 1e9) : 0;
+    return 1;
+}
+
+
+ArrivalModel* createArrivalModel(const char *spec, unsigned int seed) {
+/*
+  * Builds an arrival model from its description.
+  *
+  * @param spec E.g. "poisson:50" or "onoff:200:500:1500", see the list at the top of the file.
+  * @param seed Seed of the random models.
+  * @return The model, or NULL if the description is invalid.
+*/
+
+    static ArrivalModel model;
+    memset(&model, 0, sizeof(model));
+    model.randomState = seed;
+
+    if (strcmp(spec, "burst") == 0) {
+        model.name = "burst";
+        model.nextGapNs = gapBurst;
+    } else if (sscanf(spec, "constant:%lf", &model.rate) == 1 && model.rate > 0) {
+        model.name = "constant";
+        model.nextGapNs = gapConstant;
+        model.requestedRate = model.rate;
+    } else if (sscanf(spec, "poisson:%lf", &model.rate) == 1 && model.rate > 0) {
+        model.name = "poisson";
+        model.nextGapNs = gapPoisson;
+        model.requestedRate = model.rate;
+    } else if (sscanf(spec, "onoff:%lf:%lf:%lf", &model.rate, &model.onMs, &model.offMs) == 3 &&
+               model.rate > 0 && model.onMs > 0 && model.offMs >= 0) {
+        model.name = "onoff";
+        model.nextGapNs = gapOnOff;
+        model.requestedRate = model.rate * model.onMs / (model.onMs + model.offMs);
+    } else if (strncmp(spec, "replay:", 7) == 0 && loadReplay(&model, spec + 7)) {
+        model.name = "replay";
+        model.nextGapNs = gapReplay;
+    } else {
+        return NULL;
+    }
+    return &model;
+}
+
+
+long long nextArrivalGapNs(ArrivalModel *model) {
+/*
+  * @return Nanoseconds from the previous arrival to the next one, -1 when a replay trace is exhausted.
+*/
+
+    long long gap = model->nextGapNs(model);
+    if (gap > 0) {
+        model->elapsedNs += gap;
+    }
+    return gap;
+}
+
+
+void sleepUntilNs(long long monotonicNs) {
+    // Sleeps until an absolute CLOCK_MONOTONIC time, resuming after signals
+    struct timespec until = {monotonicNs / 1000000000LL, monotonicNs % 1000000000LL};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {}
+}
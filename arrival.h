@@ -0,0 +1,23 @@
+#ifndef ARRIVAL_H
+#define ARRIVAL_H
+
+#define ARRIVAL_TRACE_MAX 100000 // Arrivals read from a trace file
+
+// How passengers arrive at the dock, chosen with rejs -A
+typedef struct ArrivalModel {
+    const char *name;
+    double rate;          // Passengers per second (while "on" for onoff)
+    double onMs, offMs;   // onoff period lengths
+    double requestedRate; // Long-run rate the model asks for, 0 = unlimited
+    unsigned int randomState;
+    long long (*nextGapNs)(struct ArrivalModel *model);
+    long long elapsedNs;  // Scheduled time of the last arrival since the first one
+    long long *trace;     // replay: arrival offsets [ns]
+    int traceLength, traceNext;
+} ArrivalModel;
+
+ArrivalModel* createArrivalModel(const char *spec, unsigned int seed);
+long long nextArrivalGapNs(ArrivalModel *model);
+void sleepUntilNs(long long monotonicNs);
+
+#endif
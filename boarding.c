@@ -0,0 +1,388 @@
+#include "utils.h"
+#include "boarding.h"
+
+/*
+ * Boarding state machine of the ship captain. Passengers get a sequence within their class
+ * when they enter the bridge and board in sequence order within the class; between classes
+ * a smooth weighted round robin over CLASS_WEIGHTS decides, and seats in CLASS_RESERVED_SEATS
+ * stay free for their class until it has used them.
+ * With several gangways the order is kept over all of them, or, with one lane per gangway,
+ * within each gangway only: a class then has one queue per gangway, and of the queues whose
+ * next passenger is waiting the one whose passenger entered first goes.
+*/
+
+static const int classReservedSeats[] = CLASS_RESERVED_SEATS;
+static const int classWeights[] = CLASS_WEIGHTS;
+
+
+BoardingState* createBoardingState(int maxWaiting, int shipCapacity, int lanes) {
+/*
+  * Allocates an empty boarding state.
+  *
+  * @param maxWaiting Sequences each class can hand out per voyage and lane.
+  * @param shipCapacity Seats on the ship.
+  * @param lanes Boarding orders, 1 to keep one order over all gangways, else one per gangway (up to MAX_GANGWAYS).
+  * @return The new state, or NULL if out of memory.
+*/
+
+    BoardingState *state = calloc(1, sizeof(BoardingState));
+    if (state == NULL) return NULL;
+
+    state->maxWaiting = maxWaiting;
+    state->shipCapacity = shipCapacity;
+    state->lanes = lanes < 1 ? 1 : lanes > MAX_GANGWAYS ? MAX_GANGWAYS : lanes;
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            ClassQueue *queue = &state->classQueues[lane][c];
+            queue->waitingArray = calloc(maxWaiting, sizeof(int));
+            queue->enteredBridgeAt = calloc(maxWaiting, sizeof(long long));
+            queue->retries = calloc(maxWaiting, sizeof(int));
+            queue->gangways = calloc(maxWaiting, sizeof(int));
+            if (queue->waitingArray == NULL || queue->enteredBridgeAt == NULL || queue->retries == NULL || queue->gangways == NULL) {
+                destroyBoardingState(state); // Arrays not reached yet are still NULL from calloc
+                return NULL;
+            }
+        }
+    }
+    return state;
+}
+
+
+void resetBoardingState(BoardingState *state) {
+/*
+  * Empties every class queue for the next voyage.
+*/
+
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            ClassQueue *queue = &state->classQueues[lane][c];
+            int used = queue->sequenceCounter < state->maxWaiting ? queue->sequenceCounter : state->maxWaiting;
+
+            memset(queue->waitingArray, 0, used * sizeof(int));
+            queue->sequenceCounter = 0;
+            queue->nextSequenceToBoard = 0;
+            queue->reservedSequences = 0;
+        }
+    }
+    memset(state->boardedThisVoyage, 0, sizeof(state->boardedThisVoyage));
+    memset(state->credit, 0, sizeof(state->credit));
+}
+
+
+void destroyBoardingState(BoardingState *state) {
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            free(state->classQueues[lane][c].waitingArray);
+            free(state->classQueues[lane][c].enteredBridgeAt);
+            free(state->classQueues[lane][c].retries);
+            free(state->classQueues[lane][c].gangways);
+        }
+    }
+    free(state);
+}
+
+
+static ClassQueue* queueFor(BoardingState *state, int passengerClass, int gangway) {
+    // The queue a passenger on the given gangway lines up in
+    int lane = state->lanes > 1 && gangway > 0 && gangway < state->lanes ? gangway : 0;
+    return &state->classQueues[lane][passengerClass];
+}
+
+
+int boardingSeatsForClass(const BoardingState *state, int passengerClass, int peopleOnShip) {
+/*
+  * Counts the seats a passenger of the given class may still take.
+  * Seats reserved for other classes that have not yet been used are held back.
+  *
+  * @param passengerClass The boarding class of the passenger.
+  * @param peopleOnShip Current number of people on the ship.
+  * @return Number of seats available to the class.
+*/
+
+    int held = 0;
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        if (c != passengerClass && state->boardedThisVoyage[c] < classReservedSeats[c]) {
+            held += classReservedSeats[c] - state->boardedThisVoyage[c];
+        }
+    }
+    return state->shipCapacity - peopleOnShip - held;
+}
+
+
+static void skipAbandoned(ClassQueue *queue, int maxWaiting) {
+    // Moves the head of a class queue past sequences whose passengers died
+    while (queue->nextSequenceToBoard < maxWaiting && queue->waitingArray[queue->nextSequenceToBoard] == WAITING_ABANDONED) {
+        queue->waitingArray[queue->nextSequenceToBoard] = 0;
+        queue->nextSequenceToBoard++;
+    }
+}
+
+
+static ClassQueue* readyQueue(BoardingState *state, int passengerClass) {
+/*
+  * @return The queue of a class whose next passenger is waiting, over all lanes the one whose
+  *         passenger entered the bridge first, or NULL if none is.
+*/
+
+    ClassQueue *ready = NULL;
+    for (int lane = 0; lane < state->lanes; lane++) {
+        ClassQueue *queue = &state->classQueues[lane][passengerClass];
+        if (queue->nextSequenceToBoard >= state->maxWaiting || queue->waitingArray[queue->nextSequenceToBoard] == 0) {
+            continue;
+        }
+        if (ready == NULL || queue->enteredBridgeAt[queue->nextSequenceToBoard] < ready->enteredBridgeAt[ready->nextSequenceToBoard]) {
+            ready = queue;
+        }
+    }
+    return ready;
+}
+
+
+static int pickNextClassToBoard(BoardingState *state, ClassQueue **chosenQueue) {
+/*
+  * Chooses which class boards next among the classes whose next passenger is ready,
+  * using smooth weighted round robin over CLASS_WEIGHTS.
+  *
+  * @param chosenQueue Receives the queue the chosen class boards from.
+  * @return The chosen class, or -1 if no class has its next passenger waiting.
+*/
+
+    int chosen = -1, totalWeight = 0;
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        ClassQueue *queue = readyQueue(state, c);
+        if (queue == NULL) {
+            continue;
+        }
+        state->credit[c] += classWeights[c];
+        totalWeight += classWeights[c];
+        if (chosen == -1 || state->credit[c] > state->credit[chosen]) {
+            chosen = c;
+            *chosenQueue = queue;
+        }
+    }
+
+    if (chosen != -1) {
+        state->credit[chosen] -= totalWeight;
+    }
+    return chosen;
+}
+
+
+static int scheduleBoarding(BoardingState *state, ShipView *ship, long long nowNs, BoardingAction *actions, int maxActions) {
+/*
+  * Boards the next passengers in the class queues while seats allow, denying those
+  * for whom no seat is left in their class. Nobody boards once the bridge is turned
+  * towards land or the ship is leaving.
+*/
+
+    int count = 0, passengerClass;
+    ClassQueue *queue;
+    while (count < maxActions && (passengerClass = pickNextClassToBoard(state, &queue)) != -1) {
+        int seq = queue->nextSequenceToBoard;
+        int boardingOpen = ship->queueDirection != 1 && ship->shipSailing == 0;
+        int seatsAvailable = boardingSeatsForClass(state, passengerClass, ship->peopleOnShip);
+
+        if (boardingOpen && seatsAvailable <= 0 && ship->peopleToDisembark > 0) {
+            // Two-lane bridge: the seat frees up once the last voyage's passengers are off, keep waiting
+            break;
+        }
+
+        BoardingAction *action = &actions[count++];
+        action->slot = queue->waitingArray[seq] - 1;
+        action->passengerClass = passengerClass;
+        action->sequence = seq;
+        action->retries = queue->retries[seq];
+        action->gangway = queue->gangways[seq];
+        queue->waitingArray[seq] = 0;
+        queue->nextSequenceToBoard++;
+        skipAbandoned(queue, state->maxWaiting);
+
+        if (boardingOpen && seatsAvailable > 0) {
+            action->type = BOARDING_ACTION_BOARD;
+            action->fromReservation = seq < queue->reservedSequences;
+            action->latencyNs = nowNs - queue->enteredBridgeAt[seq];
+            action->peopleOnShip = ++(ship->peopleOnShip);
+            action->peopleOnBridge = --(ship->peopleOnBridge);
+            state->boardedThisVoyage[passengerClass]++;
+        } else {
+            action->type = BOARDING_ACTION_DENY;
+            if (ship->peopleOnShip >= state->shipCapacity) {
+                // Ship full, nobody else can enter
+                ship->shipSailing = 1;
+                ship->queueDirection = 1;
+            }
+        }
+    }
+    return count;
+}
+
+
+static int drainWaiting(BoardingState *state, BoardingAction *actions, int maxActions) {
+/*
+  * Denies boarding to every passenger still waiting in the class queues.
+*/
+
+    int count = 0;
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            ClassQueue *queue = &state->classQueues[lane][c];
+            int end = queue->sequenceCounter < state->maxWaiting ? queue->sequenceCounter : state->maxWaiting;
+
+            for (int seq = 0; seq < end && count < maxActions; seq++) {
+                if (queue->waitingArray[seq] > 0) {
+                    BoardingAction *action = &actions[count++];
+                    action->type = BOARDING_ACTION_DENY;
+                    action->slot = queue->waitingArray[seq] - 1;
+                    action->passengerClass = c;
+                    action->sequence = seq;
+                    action->retries = queue->retries[seq];
+                    action->gangway = queue->gangways[seq];
+                    queue->waitingArray[seq] = 0;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+
+int boardingStep(BoardingState *state, const BoardingEvent *event, ShipView *ship, BoardingAction *actions, int maxActions) {
+/*
+  * Feeds one event to the state machine.
+  *
+  * @param event The event, its passengerClass must be a valid class.
+  * @param ship Shared ship state, changed in place; not used by ENTER and DRAIN events.
+  * @param actions Receives the actions to carry out, in order.
+  * @param maxActions Room in actions. SCHEDULE and DRAIN stop when it is full and carry on
+  *                   with the next event of the same type.
+  * @return Number of actions written.
+*/
+
+    if (maxActions <= 0) {
+        return 0;
+    }
+    if (event->type == BOARDING_EVENT_SCHEDULE) {
+        return scheduleBoarding(state, ship, event->nowNs, actions, maxActions);
+    }
+    if (event->type == BOARDING_EVENT_DRAIN) {
+        return drainWaiting(state, actions, maxActions);
+    }
+
+    ClassQueue *queue = queueFor(state, event->passengerClass, event->gangway);
+    BoardingAction *action = &actions[0];
+
+    switch (event->type) {
+        case BOARDING_EVENT_ENTER:
+            action->type = BOARDING_ACTION_SEQUENCE;
+            action->sequence = queue->sequenceCounter++;
+            if (action->sequence < state->maxWaiting) {
+                queue->enteredBridgeAt[action->sequence] = event->nowNs;
+                queue->gangways[action->sequence] = event->gangway;
+            }
+            break;
+
+        case BOARDING_EVENT_WANT_TO_BOARD:
+            action->sequence = event->sequence;
+            if (ship->peopleOnShip >= state->shipCapacity) {
+                // Passenger can't enter, ship full
+                ship->shipSailing = 1;
+                ship->queueDirection = 1;
+                action->type = BOARDING_ACTION_DENY;
+            } else if (event->sequence < queue->nextSequenceToBoard) {
+                action->type = BOARDING_ACTION_STALE;
+            } else if (event->sequence >= state->maxWaiting) {
+                action->type = BOARDING_ACTION_OVERFLOW;
+            } else if (queue->waitingArray[event->sequence] == WAITING_ABANDONED) {
+                action->type = BOARDING_ACTION_STALE;
+            } else {
+                // Passenger queued in its class, the scheduler decides who goes first
+                queue->waitingArray[event->sequence] = event->slot + 1;
+                queue->retries[event->sequence] = event->retries;
+                if (event->sequence == queue->nextSequenceToBoard) {
+                    return 0;
+                }
+                action->type = BOARDING_ACTION_QUEUED;
+            }
+            break;
+
+        default:
+            return 0;
+    }
+
+    action->slot = event->slot;
+    action->passengerClass = event->passengerClass;
+    action->retries = event->retries;
+    action->gangway = event->gangway;
+    return 1;
+}
+
+
+int boardingCallReserved(BoardingState *state, int passengerClass, int gangway, long long nowNs) {
+/*
+  * Hands the next sequence of a class to a passenger called from a carry-over reservation,
+  * ahead of everyone who enters the bridge later.
+  *
+  * @param gangway The gangway the passenger is told to cross on.
+  * @return The sequence the passenger boards with.
+*/
+
+    ClassQueue *queue = queueFor(state, passengerClass, gangway);
+    int seq = queue->sequenceCounter++;
+    queue->reservedSequences = queue->sequenceCounter;
+    if (seq < state->maxWaiting) {
+        queue->enteredBridgeAt[seq] = nowNs;
+        queue->gangways[seq] = gangway;
+    }
+    return seq;
+}
+
+
+void boardingAbandon(BoardingState *state, int passengerClass, int gangway, int sequence) {
+/*
+  * Gives up a sequence whose passenger died on the bridge or before answering its reservation
+  * call: the scheduler passes over it instead of waiting for the passenger, and a request
+  * for it that is still on its way is stale.
+  *
+  * @param gangway The gangway the passenger was on or called to.
+  * @param sequence The sequence, ignored if it already boarded, was denied or was never handed out.
+*/
+
+    ClassQueue *queue = queueFor(state, passengerClass, gangway);
+    int end = queue->sequenceCounter < state->maxWaiting ? queue->sequenceCounter : state->maxWaiting;
+    if (sequence < queue->nextSequenceToBoard || sequence >= end) {
+        return;
+    }
+
+    queue->waitingArray[sequence] = WAITING_ABANDONED;
+    skipAbandoned(queue, state->maxWaiting);
+}
+
+
+int boardingReservedOutstanding(const BoardingState *state) {
+/*
+  * @return Called reservations that have not boarded (or been denied again) yet.
+*/
+
+    int outstanding = 0;
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            outstanding += state->classQueues[lane][c].reservedSequences - state->classQueues[lane][c].nextSequenceToBoard;
+        }
+    }
+    return outstanding;
+}
+
+
+int boardingQueueDepth(const BoardingState *state) {
+/*
+  * @return Sequences handed out that have not boarded or been denied yet, over all classes.
+*/
+
+    int depth = 0;
+    for (int lane = 0; lane < state->lanes; lane++) {
+        for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+            depth += state->classQueues[lane][c].sequenceCounter - state->classQueues[lane][c].nextSequenceToBoard;
+        }
+    }
+    return depth;
+}
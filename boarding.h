@@ -0,0 +1,93 @@
+#ifndef BOARDING_H
+#define BOARDING_H
+
+#include "utils.h"
+
+/*
+ * Boarding protocol of the ship captain as a state machine: bridge events go in,
+ * actions for the passengers come out. It does no IPC, takes no locks and reads no clock,
+ * so the captain's message queue is only the transport underneath it, and it can be
+ * driven and measured on its own (boardingBench).
+*/
+
+enum {
+    BOARDING_EVENT_ENTER,         // Passenger entered the bridge, asks for a sequence
+    BOARDING_EVENT_WANT_TO_BOARD, // Passenger reached the ship with its sequence
+    BOARDING_EVENT_SCHEDULE,      // Board whoever is next in line, as far as seats allow
+    BOARDING_EVENT_DRAIN          // Turn away everyone still waiting
+};
+
+enum {
+    BOARDING_ACTION_SEQUENCE, // Reply with the assigned sequence
+    BOARDING_ACTION_QUEUED,   // Passenger waits for those ahead of it, nothing to send
+    BOARDING_ACTION_BOARD,    // Passenger may board
+    BOARDING_ACTION_DENY,     // Passenger may not board on this voyage
+    BOARDING_ACTION_STALE,    // Sequence already passed, nothing to send
+    BOARDING_ACTION_OVERFLOW  // Sequence beyond the queue capacity, nothing to send
+};
+
+typedef struct {
+    int type;
+    int slot;           // Passenger's registry slot
+    int passengerClass;
+    int sequence;
+    int retries;
+    int gangway;     // ENTER: gangway the passenger is on
+    long long nowNs; // Monotonic time of the event
+} BoardingEvent;
+
+typedef struct {
+    int type;
+    int slot;                 // Passenger's registry slot, replies are addressed to it
+    int passengerClass;
+    int sequence;
+    int retries;
+    int gangway;              // Gangway the passenger is on
+    int fromReservation;      // BOARD: sequence was called from a carry-over reservation
+    long long latencyNs;      // BOARD: bridge entry -> boarding
+    int peopleOnShip;         // BOARD: counts right after this passenger boarded
+    int peopleOnBridge;
+} BoardingAction;
+
+// The part of the shared ship state the state machine reads and changes, under SEM_MUTEX
+typedef struct {
+    int peopleOnShip;
+    int peopleOnBridge;
+    int peopleToDisembark;
+    int queueDirection;
+    int shipSailing;
+} ShipView;
+
+#define WAITING_ABANDONED -1 // Sequence of a passenger that died before boarding, passed over
+
+// One ordered queue per boarding class and lane
+typedef struct {
+    int sequenceCounter; // Starting from 0, increments
+    int nextSequenceToBoard; // Who is next to board the ship
+    int *waitingArray; // waitingArray[seq] = Passenger's registry slot + 1 (or 0, or WAITING_ABANDONED)
+    long long *enteredBridgeAt; // Monotonic time the sequence was assigned [ns]
+    int *retries; // retries[seq] = times the passenger was turned away before
+    int *gangways; // gangways[seq] = gangway the passenger is on
+    int reservedSequences; // Sequences 0..reservedSequences-1 belong to carried-over reservations
+} ClassQueue;
+
+typedef struct {
+    int maxWaiting;   // Sequences per class, lane and voyage
+    int shipCapacity;
+    int lanes;        // Independent boarding orders: 1 for GANGWAY_ORDER_GLOBAL, else one per gangway
+    ClassQueue classQueues[MAX_GANGWAYS][NUM_PASSENGER_CLASSES]; // [lane][class]
+    int boardedThisVoyage[NUM_PASSENGER_CLASSES];
+    int credit[NUM_PASSENGER_CLASSES]; // Smooth weighted round robin state
+} BoardingState;
+
+BoardingState* createBoardingState(int maxWaiting, int shipCapacity, int lanes);
+void resetBoardingState(BoardingState *state);
+void destroyBoardingState(BoardingState *state);
+int boardingStep(BoardingState *state, const BoardingEvent *event, ShipView *ship, BoardingAction *actions, int maxActions);
+int boardingSeatsForClass(const BoardingState *state, int passengerClass, int peopleOnShip);
+int boardingCallReserved(BoardingState *state, int passengerClass, int gangway, long long nowNs);
+void boardingAbandon(BoardingState *state, int passengerClass, int gangway, int sequence);
+int boardingReservedOutstanding(const BoardingState *state);
+int boardingQueueDepth(const BoardingState *state);
+
+#endif
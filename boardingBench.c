@@ -0,0 +1,145 @@
+#include "utils.h"
+#include "boarding.h"
+
+/*
+ * Measures the boarding state machine on its own: boarding decisions (board or deny) per second
+ * when every passenger of a deep queue asks to board, in the order they entered the bridge,
+ * in reverse order (nobody can board until the first one arrives) and in random order.
+ * Events are fed like the captain does: a scheduling pass after every 20 messages.
+ *
+ * Usage: boardingBench [queueDepth ...]   (default: 1000 10000 100000)
+*/
+
+#define MIN_MEASURE_NS 200000000LL // Rounds are repeated for at least this long
+#define MESSAGES_PER_PASS 20       // Messages per handleBridgeQueue() pass of the captain
+#define ACTION_BUFFER 256
+
+enum { PATTERN_IN_ORDER, PATTERN_REVERSED, PATTERN_RANDOM };
+static const char *patternNames[] = {"in-order", "reversed", "random"};
+
+
+unsigned int nextRandom(unsigned int *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+int schedule(BoardingState *state, ShipView *ship, BoardingAction *actions) {
+/*
+  * Runs scheduling passes until the state machine has nothing more to decide.
+  *
+  * @return Number of boarding decisions made.
+*/
+
+    BoardingEvent event = {0};
+    int count, decisions = 0;
+
+    event.type = BOARDING_EVENT_SCHEDULE;
+    do {
+        count = boardingStep(state, &event, ship, actions, ACTION_BUFFER);
+        decisions += count;
+    } while (count == ACTION_BUFFER);
+    return decisions;
+}
+
+
+long long runRound(BoardingState *state, BoardingEvent *arrivals, const int *order, int depth, BoardingAction *actions, long long *decisions) {
+/*
+  * Fills the bridge with depth passengers, then lets them ask to board in the given order.
+  *
+  * @return Time spent on the boarding requests and scheduling passes [ns].
+*/
+
+    ShipView ship = {0};
+    ship.peopleOnBridge = depth;
+    resetBoardingState(state);
+
+    for (int i = 0; i < depth; i++) {
+        arrivals[i].type = BOARDING_EVENT_ENTER;
+        boardingStep(state, &arrivals[i], NULL, actions, 1);
+        arrivals[i].sequence = actions[0].sequence;
+        arrivals[i].type = BOARDING_EVENT_WANT_TO_BOARD;
+    }
+
+    long long start = getMonotonicTimeNs();
+    for (int i = 0; i < depth; i++) {
+        *decisions += boardingStep(state, &arrivals[order[i]], &ship, actions, 1) && actions[0].type == BOARDING_ACTION_DENY;
+        if ((i + 1) % MESSAGES_PER_PASS == 0) {
+            *decisions += schedule(state, &ship, actions);
+        }
+    }
+    *decisions += schedule(state, &ship, actions);
+    return getMonotonicTimeNs() - start;
+}
+
+
+void runPattern(int pattern, int depth) {
+/*
+  * Measures one arrival pattern at one queue depth and prints a result row.
+*/
+
+    // The ship seats everybody, so every decision is a boarding and none is cut short by a full ship
+    BoardingState *state = createBoardingState(depth, depth, 1);
+    BoardingEvent *arrivals = calloc(depth, sizeof(BoardingEvent));
+    int *order = malloc(depth * sizeof(int));
+    BoardingAction *actions = malloc(ACTION_BUFFER * sizeof(BoardingAction));
+    if (state == NULL || arrivals == NULL || order == NULL || actions == NULL) {
+        perror(RED "boardingBench allocation" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    int shares[] = CLASS_SHARE_PERCENT;
+    unsigned int random = 2463534242u;
+    for (int i = 0; i < depth; i++) {
+        int draw = nextRandom(&random) % 100, passengerClass = 0;
+        while (passengerClass < NUM_PASSENGER_CLASSES - 1 && draw >= shares[passengerClass]) {
+            draw -= shares[passengerClass++];
+        }
+        arrivals[i].slot = i;
+        arrivals[i].passengerClass = passengerClass;
+        order[i] = pattern == PATTERN_REVERSED ? depth - 1 - i : i;
+    }
+    if (pattern == PATTERN_RANDOM) {
+        for (int i = depth - 1; i > 0; i--) {
+            int j = nextRandom(&random) % (i + 1);
+            int swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+    }
+
+    long long elapsedNs = 0, decisions = 0;
+    int rounds = 0;
+    while (elapsedNs < MIN_MEASURE_NS) {
+        elapsedNs += runRound(state, arrivals, order, depth, actions, &decisions);
+        rounds++;
+    }
+
+    printf("%-9s %10d %8d %16.0f %14.1f\n", patternNames[pattern], depth, rounds, decisions / (elapsedNs / 1e9), (double)elapsedNs / decisions);
+
+    free(actions);
+    free(order);
+    free(arrivals);
+    destroyBoardingState(state);
+}
+
+
+int main(int argc, char *argv[]) {
+    int defaultDepths[] = {1000, 10000, 100000};
+    int depthCount = argc > 1 ? argc - 1 : 3;
+
+    printf("%-9s %10s %8s %16s %14s\n", "pattern", "depth", "rounds", "decisions_per_s", "ns_per_decision");
+    for (int i = 0; i < depthCount; i++) {
+        int depth = argc > 1 ? atoi(argv[i + 1]) : defaultDepths[i];
+        if (depth < 1) {
+            fprintf(stderr, RED "Queue depth must be at least 1." RESET "\n");
+            exit(EXIT_FAILURE);
+        }
+        for (int pattern = PATTERN_IN_ORDER; pattern <= PATTERN_RANDOM; pattern++) {
+            runPattern(pattern, depth);
+        }
+    }
+    return 0;
+}
@@ -12,13 +12,25 @@
 // Message types
 #define MSG_ENTER_BRIDGE 1   // Passenger: "I am entering the bridge, please give me a sequence"
 #define MSG_WANT_TO_BOARD 2  // Passenger: "I want to board the ship, I have a sequence"
-#define MSG_SEQUENCE_REPLY 3 // Captain: "Here is your sequence"
+#define MSG_SEQUENCE_REPLY 3 // Captain: "Here is your sequence" (addressed with mtype = MSG_REPLY_BASE + slot)
+#define MSG_TAKE_TICKET 4    // Passenger ashore, ship away: "put me in line for the next voyage"
+#define MSG_REPLY_BASE 16    // Captain's replies: mtype = MSG_REPLY_BASE + passenger's registry slot
+
+// Special values of BridgeMsg.sequence in boarding responses
+#define SEQ_DENIED -1          // Boarding denied, try again on the next voyage
+#define SEQ_DENIED_RESERVED -2 // Boarding denied, but a seat on the next voyage is reserved: wait to be called
+#define SEQ_TICKETED -3        // Reply to MSG_TAKE_TICKET: in line for the next voyage, wait to be called
 
 // Message structure
 typedef struct {
     long mtype;
-    pid_t pid; // Passenger's PID
+    int slot; // Passenger's registry slot, PASSENGER_ENGINE_ID_BASE + record for the passenger engine
+    int generation; // Requests: generation of the registry slot, 0 from the passenger engine
     int sequence; // assigned sequence number
+    int passengerClass; // CLASS_* boarding class
+    int retries; // How many times the passenger was turned away before this request
+    int gangway; // Gangway the passenger is on; in a reservation call, the gangway to cross on
+    long long sentAtNs; // Monotonic time the request was sent, for the captain's queueing delay
 } BridgeMsg;
 
 #endif
@@ -0,0 +1,125 @@
+#include "checkpoint.h"
+#include <sys/mman.h>
+
+static unsigned long long checksumState(const CheckpointState *state) {
+/*
+  * Computes the 64-bit FNV-1a hash of a checkpoint state.
+*/
+
+    const unsigned char *bytes = (const unsigned char *)state;
+    unsigned long long hash = 1469598103934665603ULL;
+
+    for (size_t i = 0; i < sizeof(*state); i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+Checkpoint* openCheckpoint(const char *path) {
+/*
+  * Opens (creating if needed) and maps the checkpoint file.
+  * A file written by a different layout or version is reinitialized.
+  *
+  * @param path Path of the checkpoint file.
+  * @return A pointer to the mapped checkpoint.
+*/
+
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1) {
+        perror(RED "open checkpoint" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ftruncate(fd, sizeof(Checkpoint)) == -1) {
+        perror(RED "ftruncate checkpoint" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    Checkpoint *ckpt = mmap(NULL, sizeof(Checkpoint), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ckpt == MAP_FAILED) {
+        perror(RED "mmap checkpoint" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ckpt->magic != CHECKPOINT_MAGIC || ckpt->version != CHECKPOINT_VERSION || ckpt->stateSize != sizeof(CheckpointState)) {
+        memset(ckpt, 0, sizeof(Checkpoint));
+        ckpt->magic = CHECKPOINT_MAGIC;
+        ckpt->version = CHECKPOINT_VERSION;
+        ckpt->stateSize = sizeof(CheckpointState);
+        msync(ckpt, sizeof(Checkpoint), MS_SYNC);
+    }
+
+    return ckpt;
+}
+
+
+int loadCheckpoint(Checkpoint *ckpt, CheckpointState *state) {
+/*
+  * Copies the newest slot with a valid checksum out of the checkpoint.
+  *
+  * @param ckpt The mapped checkpoint.
+  * @param state Where to store the recovered state.
+  * @return 1 if a valid state was found, 0 otherwise.
+*/
+
+    CheckpointSlot *best = NULL;
+    for (int i = 0; i < 2; i++) {
+        CheckpointSlot *slot = &ckpt->slots[i];
+        if (slot->generation == 0 || checksumState(&slot->state) != slot->checksum) {
+            continue;
+        }
+        if (best == NULL || slot->generation > best->generation) {
+            best = slot;
+        }
+    }
+
+    if (best == NULL) {
+        return 0;
+    }
+    memcpy(state, &best->state, sizeof(*state));
+    return 1;
+}
+
+
+void writeCheckpoint(Checkpoint *ckpt, const CheckpointState *state) {
+/*
+  * Writes a state into the older of the two slots and flushes it to the file.
+  * The newer slot is left untouched, so a crash during the write never loses the last checkpoint.
+  *
+  * @param ckpt The mapped checkpoint.
+  * @param state The state to store.
+*/
+
+    CheckpointSlot *older = ckpt->slots[0].generation <= ckpt->slots[1].generation ? &ckpt->slots[0] : &ckpt->slots[1];
+    CheckpointSlot *newer = older == &ckpt->slots[0] ? &ckpt->slots[1] : &ckpt->slots[0];
+
+    older->generation = 0; // invalid while being written
+    memcpy(&older->state, state, sizeof(*state));
+    older->checksum = checksumState(&older->state);
+    older->generation = newer->generation + 1;
+
+    if (msync(ckpt, sizeof(Checkpoint), MS_SYNC) == -1) {
+        perror(RED "msync checkpoint" RESET);
+    }
+}
+
+
+void closeCheckpoint(Checkpoint *ckpt) {
+// Unmaps the checkpoint file.
+
+    if (munmap(ckpt, sizeof(Checkpoint)) == -1) {
+        perror(RED "munmap checkpoint" RESET);
+    }
+}
+
+
+void removeCheckpoint(const char *path) {
+// Deletes the checkpoint file, the next start will be a cold one.
+
+    if (unlink(path) == -1 && errno != ENOENT) {
+        perror(RED "unlink checkpoint" RESET);
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "utils.h"
+
+#define CHECKPOINT_MAGIC 0x524A534BU // "RJSK"
+#define CHECKPOINT_VERSION 1
+
+// Boarding latency statistics of one class
+typedef struct {
+    long long boarded;
+    long long totalLatencyNs;
+    long long maxLatencyNs;
+    long long slaMisses;
+    long long voyageMaxLatencyNs;
+    int voyagesMissingSla;
+} ClassStats;
+
+// Ship captain's statistics of the day
+typedef struct {
+    ClassStats classStats[NUM_PASSENGER_CLASSES];
+    long long boardedTotal;
+    long long retriesTotal;
+    long long boardedFromReservation;
+    int worstRetries;
+} CaptainStats;
+
+// Everything needed to continue the day after the last completed voyage
+typedef struct {
+    SharedMemory shared; // Shared state at the voyage boundary
+    CaptainStats captain;
+} CheckpointState;
+
+// One of two alternately written copies; a torn write leaves the other one intact
+typedef struct {
+    unsigned long long generation; // 0 = never written
+    unsigned long long checksum;   // FNV-1a of state
+    CheckpointState state;
+} CheckpointSlot;
+
+// Layout of the memory-mapped checkpoint file
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int stateSize;
+    unsigned int reserved;
+    CheckpointSlot slots[2];
+} Checkpoint;
+
+Checkpoint* openCheckpoint(const char *path);
+int loadCheckpoint(Checkpoint *ckpt, CheckpointState *state);
+void writeCheckpoint(Checkpoint *ckpt, const CheckpointState *state);
+void closeCheckpoint(Checkpoint *ckpt);
+void removeCheckpoint(const char *path);
+
+#endif
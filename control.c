@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include "utils.h"
+#include "control.h"
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * Both ends of the control socket. The server side never blocks: the captain polls it
+ * from its own loops, so a slow or stuck client cannot hold up boarding.
+*/
+
+static void fillAddress(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    snprintf(address->sun_path, sizeof(address->sun_path), "%s", path);
+}
+
+
+ControlServer* openControlServer(const char *path) {
+/*
+  * Starts listening for control clients.
+  *
+  * @param path Path of the socket, replaced if it exists.
+  * @return The server.
+*/
+
+    ControlServer *server = malloc(sizeof(ControlServer));
+    if (server == NULL) {
+        perror(RED "malloc control server" RESET);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        server->clients[i].fd = -1;
+    }
+
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (server->listenFd == -1) {
+        perror(RED "socket control" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_un address;
+    fillAddress(&address, path);
+    unlink(path);
+    if (bind(server->listenFd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(server->listenFd, CONTROL_MAX_CLIENTS) == -1) {
+        perror(RED "bind/listen control socket" RESET);
+        exit(EXIT_FAILURE);
+    }
+    return server;
+}
+
+
+static void dropClient(ControlClient *client) {
+    close(client->fd);
+    client->fd = -1;
+    client->length = 0;
+    client->discarding = 0;
+}
+
+
+static int takeLine(ControlClient *client, char *command, size_t size) {
+/*
+  * Moves the first complete line out of a client's buffer, without its line ending.
+  *
+  * @return 1 if there was a complete line.
+*/
+
+    char *newline = memchr(client->buffer, '\n', client->length);
+    if (newline == NULL) {
+        return 0;
+    }
+
+    int lineLength = newline - client->buffer;
+    int copied = lineLength < (int)size - 1 ? lineLength : (int)size - 1;
+    memcpy(command, client->buffer, copied);
+    command[copied] = '\0';
+    if (copied > 0 && command[copied - 1] == '\r') command[copied - 1] = '\0';
+
+    client->length -= lineLength + 1;
+    memmove(client->buffer, newline + 1, client->length);
+    return 1;
+}
+
+
+int nextControlCommand(ControlServer *server, int *client, char *command, size_t size) {
+/*
+  * Returns the next command waiting on any connection, accepting new clients on the way.
+  * Costs one poll() when nothing is waiting.
+  *
+  * @param client Receives the index of the client to reply to.
+  * @param command Receives the command line.
+  * @return 1 if a command was returned, 0 if none is waiting.
+*/
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (server->clients[i].fd != -1 && takeLine(&server->clients[i], command, size)) {
+            *client = i;
+            return 1;
+        }
+    }
+
+    struct pollfd fds[CONTROL_MAX_CLIENTS + 1];
+    fds[0].fd = server->listenFd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        fds[i + 1].fd = server->clients[i].fd; // Negative descriptors are ignored
+        fds[i + 1].events = POLLIN;
+    }
+    if (poll(fds, CONTROL_MAX_CLIENTS + 1, 0) <= 0) {
+        return 0;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        int fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK);
+        int slot = 0;
+        while (slot < CONTROL_MAX_CLIENTS && server->clients[slot].fd != -1) slot++;
+        if (fd != -1 && slot == CONTROL_MAX_CLIENTS) {
+            close(fd); // Too many clients
+        } else if (fd != -1) {
+            server->clients[slot].fd = fd;
+            server->clients[slot].length = 0;
+            server->clients[slot].discarding = 0;
+        }
+    }
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        ControlClient *controlClient = &server->clients[i];
+        if (controlClient->fd == -1 || fds[i + 1].fd != controlClient->fd || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+
+        ssize_t received = recv(controlClient->fd, controlClient->buffer + controlClient->length, CONTROL_LINE_LENGTH - controlClient->length, 0);
+        if (received <= 0) {
+            if (received == 0 || (errno != EAGAIN && errno != EINTR)) dropClient(controlClient);
+            continue;
+        }
+        controlClient->length += received;
+
+        if (controlClient->discarding) {
+            // The rest of a line that was too long, up to and including its '\n'
+            char *newline = memchr(controlClient->buffer, '\n', controlClient->length);
+            if (newline == NULL) {
+                controlClient->length = 0;
+                continue;
+            }
+            controlClient->length -= newline + 1 - controlClient->buffer;
+            memmove(controlClient->buffer, newline + 1, controlClient->length);
+            controlClient->discarding = 0;
+        }
+
+        if (takeLine(controlClient, command, size)) {
+            *client = i;
+            return 1;
+        }
+        if (controlClient->length == CONTROL_LINE_LENGTH) {
+            replyControl(server, i, 0, "line too long");
+            controlClient->length = 0;
+            controlClient->discarding = 1;
+        }
+    }
+    return 0;
+}
+
+
+void replyControl(ControlServer *server, int client, int ok, const char *details) {
+/*
+  * Acknowledges a command, stamped with the current monotonic time.
+  * A client that does not read its replies loses them rather than blocking the captain.
+*/
+
+    char reply[CONTROL_LINE_LENGTH + 64];
+    int length = snprintf(reply, sizeof(reply), "%s %lld %s\n", ok ? "ok" : "error", getMonotonicTimeNs(), details);
+    if (length >= (int)sizeof(reply)) length = sizeof(reply) - 1;
+
+    if (server->clients[client].fd != -1 && send(server->clients[client].fd, reply, length, MSG_DONTWAIT | MSG_NOSIGNAL) == -1 && errno != EAGAIN) {
+        dropClient(&server->clients[client]);
+    }
+}
+
+
+int waitControlServer(ControlServer *server, long long timeoutNs) {
+/*
+  * Sleeps until a control client connects or sends something, a signal arrives or the timeout passes.
+  *
+  * @return As ppoll(): -1 with errno EINTR when a signal arrived.
+*/
+
+    struct pollfd fds[CONTROL_MAX_CLIENTS + 1];
+    fds[0].fd = server->listenFd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        fds[i + 1].fd = server->clients[i].fd;
+        fds[i + 1].events = POLLIN;
+    }
+
+    struct timespec timeout = {timeoutNs / 1000000000LL, timeoutNs % 1000000000LL};
+    return ppoll(fds, CONTROL_MAX_CLIENTS + 1, &timeout, NULL);
+}
+
+
+void closeControlServer(ControlServer *server, const char *path) {
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (server->clients[i].fd != -1) dropClient(&server->clients[i]);
+    }
+    close(server->listenFd);
+    unlink(path);
+    free(server);
+}
+
+
+int connectControl(const char *path, int timeoutMs) {
+/*
+  * Connects to the ship captain's control socket, waiting for it to appear.
+  *
+  * @param path Path of the socket.
+  * @param timeoutMs How long to keep retrying.
+  * @return The connected descriptor, or -1.
+*/
+
+    struct sockaddr_un address;
+    fillAddress(&address, path);
+    long long deadline = getMonotonicTimeNs() + timeoutMs * 1000000LL;
+
+    while (1) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        int error = errno;
+        close(fd);
+        if ((error != ENOENT && error != ECONNREFUSED) || getMonotonicTimeNs() >= deadline) {
+            return -1;
+        }
+        usleep(10000);
+    }
+}
+
+
+int sendControlCommand(int fd, const char *command, char *reply, size_t size) {
+/*
+  * Sends one command and waits for its acknowledgement.
+  *
+  * @param command The command, without line ending.
+  * @param reply Receives the reply line, without line ending.
+  * @return 1 for "ok", 0 for "error", -1 if the connection failed.
+*/
+
+    char line[CONTROL_LINE_LENGTH];
+    int length = snprintf(line, sizeof(line), "%s\n", command);
+    if (length >= (int)sizeof(line) || send(fd, line, length, MSG_NOSIGNAL) != length) {
+        return -1;
+    }
+
+    // One reply per command and nothing unsolicited, so whatever arrives belongs to this command
+    size_t received = 0;
+    char *newline = NULL;
+    while (newline == NULL && received < size - 1) {
+        ssize_t count = recv(fd, reply + received, size - 1 - received, 0);
+        if (count <= 0) {
+            if (count == -1 && errno == EINTR) continue;
+            return -1;
+        }
+        newline = memchr(reply + received, '\n', count);
+        received += count;
+    }
+    reply[newline != NULL ? (size_t)(newline - reply) : received] = '\0';
+    return strncmp(reply, "ok ", 3) == 0 ? 1 : 0;
+}
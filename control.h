@@ -0,0 +1,40 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+
+/*
+ * Control plane of the ship captain: a local Unix stream socket taking one text command
+ * per line and answering each with one line,
+ *     "ok <monotonicNs> <details>"  or  "error <monotonicNs> <reason>",
+ * where monotonicNs is the CLOCK_MONOTONIC time the command took effect in the captain.
+ *
+ * Commands: depart (early departure), end (end of day), status, policy <departurePolicy>
+*/
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_LENGTH 256
+#define CONTROL_CONNECT_TIMEOUT_MS 10000 // How long clients wait for the captain to listen
+
+typedef struct {
+    int fd; // -1 = unused
+    char buffer[CONTROL_LINE_LENGTH];
+    int length;
+    int discarding; // Skipping the rest of a line that did not fit the buffer
+} ControlClient;
+
+typedef struct {
+    int listenFd;
+    ControlClient clients[CONTROL_MAX_CLIENTS];
+} ControlServer;
+
+ControlServer* openControlServer(const char *path);
+int nextControlCommand(ControlServer *server, int *client, char *command, size_t size);
+void replyControl(ControlServer *server, int client, int ok, const char *details);
+int waitControlServer(ControlServer *server, long long timeoutNs);
+void closeControlServer(ControlServer *server, const char *path);
+
+int connectControl(const char *path, int timeoutMs);
+int sendControlCommand(int fd, const char *command, char *reply, size_t size);
+
+#endif
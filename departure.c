@@ -0,0 +1,106 @@
+#include "utils.h"
+#include "departure.h"
+
+/*
+ * Departure policies of the ship captain. Each one decides, while the ship is loading,
+ * whether the loading window closes now. SIGUSR1 still closes it under any policy.
+ *
+ *   fixed         load for TIME_BETWEEN_TRIPS (the original behaviour)
+ *   full          depart as soon as no seat is left that any class may take
+ *   load[:f]      depart once the load factor reaches f (DEPARTURE_TARGET_LOAD by default)
+ *   rate          depart once the estimated arrival rate drops below the rate this voyage
+ *                 would achieve by leaving now, i.e. when waiting longer lowers throughput
+ *
+ * The adaptive policies leave after DEPARTURE_MAX_WAIT_MS at the latest.
+*/
+
+static int departFixed(DeparturePolicy *policy, const LoadingProgress *progress) {
+    (void)policy;
+    return progress->elapsedNs >= TIME_BETWEEN_TRIPS * 1000000000LL;
+}
+
+
+static int departFull(DeparturePolicy *policy, const LoadingProgress *progress) {
+    (void)policy;
+    return progress->openSeats <= 0 || progress->elapsedNs >= DEPARTURE_MAX_WAIT_MS * 1000000LL;
+}
+
+
+static int departOnLoad(DeparturePolicy *policy, const LoadingProgress *progress) {
+    return progress->peopleOnShip >= policy->parameter * SHIP_CAPACITY || progress->openSeats <= 0 || progress->elapsedNs >= DEPARTURE_MAX_WAIT_MS * 1000000LL;
+}
+
+
+static void startRateWindow(DeparturePolicy *policy) {
+    // The estimate carries over from the previous window, only the slot restarts
+    policy->slotStartNs = 0;
+    policy->slotStartBoarded = 0;
+}
+
+
+static int departOnRate(DeparturePolicy *policy, const LoadingProgress *progress) {
+/*
+  * Updates the arrival rate estimate once per DEPARTURE_RATE_SLOT_MS and departs when the
+  * next passengers are expected to arrive more slowly than this voyage is paying off:
+  * rate < boarded / (loading time + trip time).
+*/
+
+    if (progress->openSeats <= 0 || progress->elapsedNs >= DEPARTURE_MAX_WAIT_MS * 1000000LL) {
+        return 1;
+    }
+
+    long long slotNs = progress->elapsedNs - policy->slotStartNs;
+    if (slotNs < DEPARTURE_RATE_SLOT_MS * 1000000LL) {
+        return 0;
+    }
+
+    double slotRate = (progress->boardedInWindow - policy->slotStartBoarded) / (slotNs / 1e9);
+    policy->arrivalRate = policy->arrivalRate == 0 ? slotRate : 0.7 * policy->arrivalRate + 0.3 * slotRate;
+    policy->slotStartNs = progress->elapsedNs;
+    policy->slotStartBoarded = progress->boardedInWindow;
+
+    double voyageRate = progress->boardedInWindow / (progress->elapsedNs / 1e9 + TRIP_DURATION);
+    return progress->boardedInWindow > 0 && policy->arrivalRate < voyageRate;
+}
+
+
+static void startWindowNothing(DeparturePolicy *policy) {
+    (void)policy;
+}
+
+
+static DeparturePolicy policies[] = {
+    {.name = "fixed", .shouldDepart = departFixed, .startWindow = startWindowNothing},
+    {.name = "full", .shouldDepart = departFull, .startWindow = startWindowNothing},
+    {.name = "load", .parameter = DEPARTURE_TARGET_LOAD, .shouldDepart = departOnLoad, .startWindow = startWindowNothing},
+    {.name = "rate", .shouldDepart = departOnRate, .startWindow = startRateWindow},
+};
+
+
+DeparturePolicy* selectDeparturePolicy(const char *spec) {
+/*
+  * Looks up a departure policy.
+  *
+  * @param spec Policy name, optionally followed by ":parameter" (e.g. "load:0.9").
+  * @return The policy, or NULL if there is no such policy or the parameter is invalid.
+*/
+
+    const char *colon = strchr(spec, ':');
+    size_t nameLength = colon != NULL ? (size_t)(colon - spec) : strlen(spec);
+
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        if (strlen(policies[i].name) != nameLength || strncmp(policies[i].name, spec, nameLength) != 0) {
+            continue;
+        }
+        if (colon != NULL) {
+            char *end;
+            double parameter = strtod(colon + 1, &end);
+            if (policies[i].shouldDepart != departOnLoad || *end != '\0' || parameter <= 0 || parameter > 1) {
+                return NULL;
+            }
+            policies[i].parameter = parameter;
+        }
+        return &policies[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef DEPARTURE_H
+#define DEPARTURE_H
+
+// What a departure policy sees of the loading window in progress
+typedef struct {
+    long long elapsedNs;  // Since the loading window opened
+    int peopleOnShip;
+    int openSeats;        // Seats any class may still take, seats held for a class do not count
+    int boardedInWindow;  // Boarded since the window opened
+} LoadingProgress;
+
+// A way of deciding when the loading window closes, chosen with rejs -D
+typedef struct DeparturePolicy {
+    const char *name;
+    double parameter; // Target load factor of "load", unused otherwise
+    int (*shouldDepart)(struct DeparturePolicy *policy, const LoadingProgress *progress);
+    void (*startWindow)(struct DeparturePolicy *policy);
+    // State of the "rate" policy
+    double arrivalRate;    // Boardings per second, exponentially weighted
+    long long slotStartNs; // Current estimation slot
+    int slotStartBoarded;
+} DeparturePolicy;
+
+DeparturePolicy* selectDeparturePolicy(const char *spec);
+
+#endif
@@ -1,84 +1,97 @@
 #include "utils.h"
+#include "control.h"
 
 int main(int argc, char *argv[]) {
 /*
   * Main function for the Harbour Captain process.
-  * Reads the ship captain's PID from the FIFO and starts managing signals for early cruises,
-  * end-of-day operations, or exits based on user input.
+  * Connects to the ship captain's control socket and starts sending commands for early cruises,
+  * end-of-day operations, status queries or departure policy changes based on user input.
+  * Started by rejs with the shared region and semaphores, it reports ready once connected.
 */
 
-    if (argc != 1) {
-        fprintf(stderr, RED "Usage: %s" RESET "\n", argv[0]);
+    if (argc != 1 && argc != 3) {
+        fprintf(stderr, RED "Usage: %s [<regionFd> <semid>]" RESET "\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Opening FIFO for reading
-    int fifo_fd = open(FIFO_PATH, O_RDONLY);
-    if (fifo_fd == -1) {
-        perror(RED "open FIFO" RESET);
+    int controlFd = connectControl(CONTROL_SOCKET_PATH, CONTROL_CONNECT_TIMEOUT_MS);
+    if (controlFd == -1) {
+        perror(RED "connect control socket" RESET);
         exit(EXIT_FAILURE);
     }
 
-    pid_t shipCaptainPID;
-    if (read(fifo_fd, &shipCaptainPID, sizeof(shipCaptainPID)) == -1) {
-        perror(RED "read from FIFO" RESET);
-        exit(EXIT_FAILURE);
+    printf(MAGENTA "=== Harbour Captain ===" RESET " Connected to the ship captain on %s\n", CONTROL_SOCKET_PATH);
+    if (argc == 3) {
+        reportReady(attachSharedMemory(atoi(argv[1])), atoi(argv[2]), ROLE_HARBOUR_CAPTAIN);
+        detachSharedMemory();
     }
 
-    printf(MAGENTA "=== Harbour Captain ===" RESET " The PID of the ship's captain was received: %d\n", shipCaptainPID);
-    close(fifo_fd); // Closing FIFO
+    launchHarbourCaptain(controlFd);
+    close(controlFd);
 
-    launchHarbourCaptain(shipCaptainPID);
-    
     return 0;
 }
 
 
-void launchHarbourCaptain(pid_t shipCaptainPID) {
+void launchHarbourCaptain(int controlFd) {
 /*
-  * Starts the Harbour Captain's interactive signal management process.
-  * Listens for user input to send signals to the ship captain to trigger early departures,
-  * end-of-day operations, or to exit.
+  * Starts the Harbour Captain's interactive command loop.
+  * Listens for user input and sends the matching command to the ship captain, printing its
+  * acknowledgement with the round trip and the delay until the command took effect.
   *
-  * @param shipCaptainPID The PID of the ship captain process.
+  * @param controlFd Connection to the ship captain's control socket.
 */
 
-    printf(MAGENTA "=== Habour Captain ===" RESET " Starting\n");
-    printf(MAGENTA "=== Habour Captain ===" RESET " Enter: w = early cruise, k = end of day, q = exit\n");
+    printf(MAGENTA "=== Harbour Captain ===" RESET " Starting\n");
+    printf(MAGENTA "=== Harbour Captain ===" RESET " Enter: w = early cruise, k = end of day, s = status, p <policy> = departure policy, q = exit\n");
 
-    char c;
+    char line[CONTROL_LINE_LENGTH], command[sizeof(line) + sizeof("policy ")], reply[CONTROL_LINE_LENGTH + 64];
     while (1) {
-        c = getchar();
-        if (c == '\n') continue;
+        if (fgets(line, sizeof(line), stdin) == NULL) {
+            strcpy(line, "q"); // End of input ends the shift like q
+        } else if (strchr(line, '\n') == NULL && !feof(stdin)) {
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF); // Drop the rest, it is not a command either
+            printf(MAGENTA "=== Harbour Captain ===" RESET " Command too long.\n");
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') continue;
 
-        // Buffer clearing
-        while (getchar() != '\n');
+        if (strcmp(line, "w") == 0) {
+            strcpy(command, "depart");
+        } else if (strcmp(line, "k") == 0) {
+            strcpy(command, "end");
+        } else if (strcmp(line, "s") == 0) {
+            strcpy(command, "status");
+        } else if (line[0] == 'p' && line[1] == ' ') {
+            snprintf(command, sizeof(command), "policy %s", line + 2);
+        } else if (strcmp(line, "q") == 0) {
+            printf(MAGENTA "=== Harbour Captain ===" RESET " I'm finishing up my work for today.\n");
+            break;
+        } else {
+            printf(MAGENTA "=== Harbour Captain ===" RESET " Unknown command.\n");
+            continue;
+        }
 
-        if (c == 'w') {
-            // sigusr1 to ship captain
-            if (kill(shipCaptainPID, SIGUSR1) == -1) {
-                perror(RED "kill SIGUSR1" RESET);
-            } else {
-                printf(MAGENTA "=== Harbour Captain ===" RESET " Early departure signal sent.\n");
-            }
-        } 
-        else if (c == 'k') {
-            // sigusr2 to ship captain
-            if (kill(shipCaptainPID, SIGUSR2) == -1) {
-                perror(RED "kill SIGUSR2" RESET);
-            } else {
-                printf(MAGENTA "=== Harbour Captain ===" RESET " End-of-day signal sent. I'm finishing up my work for today.\n");
-                break;
-            }
+        long long sentNs = getMonotonicTimeNs();
+        int result = sendControlCommand(controlFd, command, reply, sizeof(reply));
+        long long roundTripNs = getMonotonicTimeNs() - sentNs;
+        if (result == -1) {
+            printf(MAGENTA "=== Harbour Captain ===" RESET " The ship captain is gone.\n");
+            break;
         }
-        else if (c == 'q') {
+
+        // Reply: "ok|error <effectNs> <details>"
+        long long effectNs = 0;
+        int detailsAt = 0;
+        sscanf(reply, "%*s %lld %n", &effectNs, &detailsAt);
+        printf(MAGENTA "=== Harbour Captain ===" RESET " %s %s: %s (round trip %.3f ms, took effect after %.3f ms)\n",
+               command, result ? "acknowledged" : "refused", reply + detailsAt, roundTripNs / 1e6, (effectNs - sentNs) / 1e6);
+
+        if (result && strcmp(command, "end") == 0) {
             printf(MAGENTA "=== Harbour Captain ===" RESET " I'm finishing up my work for today.\n");
             break;
         }
-        else {
-            printf(MAGENTA "=== Harbour Captain ===" RESET " Unknown command.\n");
-        }
     }
-
-    return;
 }
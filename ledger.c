@@ -0,0 +1,139 @@
+#include "utils.h"
+#include "ledger.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+int openLedger(const char *path) {
+/*
+  * Opens the ledger for appending, creating it with its header if needed and cutting a torn
+  * last record back to the last complete one. A file of another layout is left alone and
+  * nothing is recorded.
+  *
+  * @param path Path of the ledger file.
+  * @return The descriptor to append to, or -1.
+*/
+
+    int fd = open(path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (fd == -1) {
+        perror(RED "open ledger" RESET);
+        return -1;
+    }
+
+    LedgerHeader header;
+    ssize_t length = pread(fd, &header, sizeof(header), 0);
+    if (length == 0) {
+        header.magic = LEDGER_MAGIC;
+        header.version = LEDGER_VERSION;
+        header.recordSize = sizeof(VoyageRecord);
+        header.reserved = 0;
+        if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+            perror(RED "write ledger header" RESET);
+            close(fd);
+            return -1;
+        }
+    } else if (length != sizeof(header) || header.magic != LEDGER_MAGIC || header.version != LEDGER_VERSION || header.recordSize != sizeof(VoyageRecord)) {
+        fprintf(stderr, RED "%s is not a ledger of this version, voyages are not recorded." RESET "\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // Cut off a record torn by a crash, or every later append would be misaligned
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        perror(RED "fstat ledger" RESET);
+        close(fd);
+        return -1;
+    }
+    off_t torn = (info.st_size - (off_t)sizeof(LedgerHeader)) % (off_t)sizeof(VoyageRecord);
+    if (torn > 0) {
+        fprintf(stderr, YELLOW "%s ends in a torn record, cutting off %lld bytes." RESET "\n", path, (long long)torn);
+        if (ftruncate(fd, info.st_size - torn) == -1) {
+            perror(RED "ftruncate ledger" RESET);
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+
+void appendLedgerRecord(int fd, const VoyageRecord *record) {
+/*
+  * Appends one voyage with a single write(), so records never interleave. A crash can only
+  * leave a partial record at the end, which the next openLedger cuts off.
+*/
+
+    if (fd != -1 && write(fd, record, sizeof(*record)) != sizeof(*record)) {
+        perror(RED "write ledger record" RESET);
+    }
+}
+
+
+VoyageRecord* readLedger(const char *path, size_t *count, size_t *skipped) {
+/*
+  * Maps a ledger read-only and copies out its complete records. Damaged bytes (a torn record
+  * that later appends were written behind, in a ledger from before openLedger cut them off)
+  * are skipped by scanning ahead for the next record magic.
+  *
+  * @param count Receives the number of complete records.
+  * @param skipped Receives the number of damaged stretches skipped.
+  * @return The records, to be freed by the caller, or NULL if the file is missing or not a ledger.
+*/
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(RED "open ledger" RESET);
+        return NULL;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(LedgerHeader)) {
+        fprintf(stderr, RED "%s is not a ledger." RESET "\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    const LedgerHeader *header = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (header == MAP_FAILED) {
+        perror(RED "mmap ledger" RESET);
+        return NULL;
+    }
+    if (header->magic != LEDGER_MAGIC || header->version != LEDGER_VERSION || header->recordSize != sizeof(VoyageRecord)) {
+        fprintf(stderr, RED "%s is not a ledger of this version." RESET "\n", path);
+        munmap((void *)header, info.st_size);
+        return NULL;
+    }
+
+    const unsigned char *data = (const unsigned char *)(header + 1);
+    size_t length = info.st_size - sizeof(LedgerHeader);
+    VoyageRecord *records = malloc((length / sizeof(VoyageRecord) + 1) * sizeof(VoyageRecord));
+    if (records == NULL) {
+        perror(RED "malloc ledger" RESET);
+        munmap((void *)header, info.st_size);
+        return NULL;
+    }
+
+    const unsigned int magic = LEDGER_RECORD_MAGIC;
+    size_t offset = 0;
+    int damaged = 0;
+    *count = 0;
+    *skipped = 0;
+    while (offset + sizeof(VoyageRecord) <= length) {
+        if (memcmp(data + offset, &magic, sizeof(magic)) == 0) {
+            // Records past a torn one are not aligned in the mapping, so each is copied
+            memcpy(&records[(*count)++], data + offset, sizeof(VoyageRecord));
+            offset += sizeof(VoyageRecord);
+            damaged = 0;
+            continue;
+        }
+        if (!damaged) (*skipped)++;
+        damaged = 1;
+        offset++;
+    }
+    if (offset < length && !damaged) (*skipped)++; // A torn record at the very end
+
+    munmap((void *)header, info.st_size);
+    return records;
+}
@@ -0,0 +1,54 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <stddef.h>
+
+/*
+ * Voyage ledger: an append-only file of fixed-size binary records, one per voyage, written
+ * by the ship captain and kept across runs (LEDGER_PATH). rejs-ledger maps it and summarizes
+ * any number of days without parsing logs.
+*/
+
+#define LEDGER_MAGIC 0x4C534A52U        // "RJSL", file header
+#define LEDGER_RECORD_MAGIC 0x56594F56U // "VOYV", every record
+#define LEDGER_VERSION 1
+
+// Why the loading window closed
+#define DEPARTURE_REASON_TIMER 0  // The departure policy closed it (the timer of "fixed")
+#define DEPARTURE_REASON_SIGNAL 1 // SIGUSR1 or the "depart" command
+#define DEPARTURE_REASON_FULL 2   // Every open seat taken and the bridge empty
+#define DEPARTURE_REASONS 3
+#define DEPARTURE_REASON_NAMES {"timer", "signal", "full"}
+
+// First bytes of the file
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned int reserved;
+} LedgerHeader;
+
+// One voyage, 96 bytes
+typedef struct {
+    unsigned int magic;       // LEDGER_RECORD_MAGIC, readers resync on it past damaged bytes
+    int voyage;               // Voyage of the day, from 1
+    long long dayStartNs;     // CLOCK_REALTIME the captain started the day, tells runs apart
+    long long startNs;        // CLOCK_REALTIME the loading window opened
+    long long endNs;          // CLOCK_REALTIME the last passenger of the voyage was off the ship
+    long long loadingNs;      // Loading window
+    long long preparationNs;  // Clearing the bridge before departure
+    long long disembarkNs;    // Arrival -> last passenger off, 0 if the day ended at sea
+    int departureReason;      // DEPARTURE_REASON_*
+    int passengers;           // Carried on the voyage
+    int denials;              // Passengers turned away while it was loaded
+    int peakBridge;           // Most people on the bridge towards the ship while loading
+    int wastedTrips;          // Bridge round trips without boarding
+    int shipCapacity;
+    char departurePolicy[16];
+} VoyageRecord;
+
+int openLedger(const char *path);
+void appendLedgerRecord(int fd, const VoyageRecord *record);
+VoyageRecord* readLedger(const char *path, size_t *count, size_t *skipped);
+
+#endif
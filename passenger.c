@@ -1,10 +1,25 @@
 #include "utils.h"
 #include "bridge_queue.h"
+#include "request_ring.h"
 #include "passenger.h"
-
-int shmid, semid, msq_id;
-int onShip, mySequence, lastTripTried, waitingForNextArrival;
+#include "trace.h"
+#include "registry.h"
+
+int regionFd, semid, msq_id;
+int onShip, mySequence, lastTripTried, waitingForNextArrival, myClass;
+int holdsReservation, retries;
+int myVoyage; // sm->currentVoyage when I boarded, I leave at the next arrival
+int landLane; // Semaphore of the lane towards land
+int myGangway; // Gangway towards the ship I am on or about to take
+int *landLaneCount; // People on the lane towards land
+int waitingForBridge; // "bridge wait" span is open
+int ticketRefusedVoyage; // Voyage the captain refused me a ticket for, not asked again
 SharedMemory *sm;
+RequestRing *requestRing; // NULL when requests go over the SysV queue
+PassengerRegistry *registry;
+int mySlot; // My registry slot, my address in the bridge protocol
+int myGeneration; // Generation of my slot, sent with every request
+long myMtype; // Replies addressed to me
 pid_t myPID;
 
 int main(int argc, char *argv[]) {
@@ -15,7 +30,9 @@ int main(int argc, char *argv[]) {
         checkSignals();
     
         if (!onShip) {
-            if (waitingForNextArrival) {
+            if (holdsReservation) {
+                waitForReservationCall();
+            } else if (waitingForNextArrival) {
                 waitForShipToReturn();
             } else {
                 attemptBoardBridge();
@@ -29,20 +46,16 @@ int main(int argc, char *argv[]) {
 
 void initialize(int argc, char *argv[]) {
     if (argc != 3) {
-        fprintf(stderr, RED "Usage: %s <shmid> <semid>" RESET "\n", argv[0]);
+        fprintf(stderr, RED "Usage: %s <regionFd> <semid>" RESET "\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    srand(time(NULL));
+    srand(time(NULL) ^ getpid());
 
-    shmid = atoi(argv[1]);
+    regionFd = atoi(argv[1]);
     semid = atoi(argv[2]);
 
-    sm = attachSharedMemory(shmid);
-    if (sm == (void *)-1) {
-        perror(RED "shmat passenger" RESET);
-        exit(EXIT_FAILURE);
-    }
+    sm = attachSharedMemory(regionFd);
 
     msq_id = msgget(BRIDGE_QUEUE_KEY, 0);
     if (msq_id == -1) {
@@ -50,12 +63,98 @@ void initialize(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
+    if (sm->requestTransport == REQUEST_TRANSPORT_RING) {
+        requestRing = attachSharedSection(SECTION_REQUEST_RING);
+    }
+
     myPID = getpid();
+    traceInit("passenger", 3);
 
     onShip = 0; // flag: am I already on the ship?
     mySequence = -1; // unique sequence number
     lastTripTried = -1; // Cruise we recently tried to enter
     waitingForNextArrival = 0; // After unsuccessful attempt to board ship, passenger waits in port for next voyage
+    myClass = drawPassengerClass(); // Boarding class (crew, reduced mobility, priority, standard)
+    holdsReservation = 0; // Denied with a seat reserved on the next voyage, captain will call us
+    retries = 0; // How many times we were turned away
+    waitingForBridge = 0;
+    ticketRefusedVoyage = -1;
+
+    // Without a registry slot the captain could not address us
+    registry = attachSharedSection(SECTION_REGISTRY);
+    mySlot = registryClaim(registry, myPID, myClass);
+    if (mySlot == -1) {
+        printf(CYAN "=== Passenger %d ===" RESET " The passenger registry is full, I'm not coming today.\n", myPID);
+        detachSharedMemory();
+        exit(0);
+    }
+    myMtype = MSG_REPLY_BASE + mySlot;
+    myGeneration = atomic_load(&registry->slots[mySlot].generation);
+
+    // Replies the captain sent to a passenger that died in this slot before us are not ours
+    BridgeMsg stale;
+    while (msgrcv(msq_id, &stale, sizeof(stale) - sizeof(long), myMtype, IPC_NOWAIT) != -1);
+
+    // On a two-lane bridge disembarking has its own lane
+    landLane = sm->twoLaneBridge ? SEM_BRIDGE_INBOUND : SEM_BRIDGE;
+    landLaneCount = sm->twoLaneBridge ? &sm->peopleOnBridgeInbound : &sm->peopleOnBridge;
+}
+
+
+int drawPassengerClass() {
+    // Draws the boarding class according to CLASS_SHARE_PERCENT
+    int shares[] = CLASS_SHARE_PERCENT;
+    int roll = rand() % 100;
+
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        if (roll < shares[c]) {
+            return c;
+        }
+        roll -= shares[c];
+    }
+    return CLASS_STANDARD;
+}
+
+
+void sendToCaptain(BridgeMsg *msg) {
+    // Sends a bridge request to the captain over the transport rejs chose
+    msg->generation = myGeneration;
+    msg->sentAtNs = getMonotonicTimeNs();
+
+    if (requestRing != NULL) {
+        while (!requestRingPush(requestRing, msg)) {
+            usleep(100); // Ring full, the captain drains it in batches
+        }
+    } else if (msgsnd(msq_id, msg, sizeof(*msg) - sizeof(long), 0) == -1) {
+        perror(msg->mtype == MSG_ENTER_BRIDGE ? "msgsnd ENTER_BRIDGE" : msg->mtype == MSG_TAKE_TICKET ? "msgsnd TAKE_TICKET" : "msgsnd WANT_TO_BOARD");
+    }
+}
+
+
+int trySendToCaptain(BridgeMsg *msg) {
+/*
+  * Sends a bridge request like sendToCaptain(), but never waits for room. Safe with SEM_MUTEX held.
+  * On the SysV queue it also leaves half of the queue free: requests and the captain's replies
+  * share it, and a queue filled with requests would block the captain's next reply for good.
+  *
+  * @return 1 if the request was queued, 0 if the ring or queue is full.
+*/
+
+    msg->generation = myGeneration;
+    msg->sentAtNs = getMonotonicTimeNs();
+
+    if (requestRing != NULL) {
+        return requestRingPush(requestRing, msg);
+    }
+    struct msqid_ds queue;
+    if (msgctl(msq_id, IPC_STAT, &queue) == 0 && queue.msg_qnum * (sizeof(*msg) - sizeof(long)) * 2 >= queue.msg_qbytes) {
+        return 0;
+    }
+    if (msgsnd(msq_id, msg, sizeof(*msg) - sizeof(long), IPC_NOWAIT) == -1) {
+        if (errno != EAGAIN) perror("msgsnd TAKE_TICKET");
+        return 0;
+    }
+    return 1;
 }
 
 
@@ -71,15 +170,42 @@ void checkSignals() {
             printf(CYAN "=== Passenger %d ===" RESET " Exiting port.\n", myPID);
         }
 
-        shmdt(sm);
-        exit(0);
+        leavePort();
     }
 }
 
 
 void attemptBoardBridge() {
-    waitSemaphore(semid, SEM_BRIDGE);
-    waitSemaphore(semid, SEM_MUTEX);
+    if (!waitingForBridge) {
+        traceBegin("bridge wait");
+        waitingForBridge = 1;
+    }
+
+#if PRE_TICKETING
+    // The gate would keep me asleep until the bridge opens again, ask for a ticket first.
+    // Read without SEM_MUTEX: the captain checks again whether the ship is away. A gate closed
+    // early while the ship still loads gets no tickets, asking then would only be refused.
+    int tripWhenClosed = sm->currentVoyage;
+    int shipAway = sm->queueDirection == 1 || sm->shipSailing == 1;
+    if (ticketRefusedVoyage != tripWhenClosed && shipAway && boardingGateClosed(semid)) {
+        requestTicket(tripWhenClosed);
+        return;
+    }
+#endif
+
+    // Sleeps while boarding is closed, the flags below are still checked: the gate opens
+    // only once the captain has set them for boarding
+    myGangway = chooseGangway();
+#if PRE_TICKETING
+    // Passengers who fell asleep here while boarding was open would otherwise all rush the gate
+    // when it opens again: once it has closed, they go back to the ticket check above
+    int recheckMs = ticketRefusedVoyage != sm->currentVoyage ? BOARDING_GATE_RECHECK_MS : 0;
+#else
+    int recheckMs = 0;
+#endif
+    if (!passBoardingGate(semid, SEM_GANGWAY(myGangway), recheckMs)) {
+        return;
+    }
 
     int queueDir = sm->queueDirection;
     int shipSail = sm->shipSailing;
@@ -87,38 +213,41 @@ void attemptBoardBridge() {
 
     if (queueDir == 0 && shipSail == 0) {
         // I can board the bridge
-        printf(CYAN "=== Passenger %d ===" RESET " I entered the bridge. PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", myPID, sm->peopleOnShip, ++(sm->peopleOnBridge));
+        printf(CYAN "=== Passenger %d ===" RESET " I entered the bridge (gangway %d). PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", myPID, myGangway, sm->peopleOnShip, ++(sm->peopleOnBridge));
+        sm->peopleOnGangway[myGangway]++;
+        // Registered with the count, so the captain can give my place back if I die on the bridge
+        atomic_store(&registry->slots[mySlot].sequence, -1);
+        registry->slots[mySlot].gangway = myGangway;
+        registrySetState(registry, mySlot, REGISTRY_ON_BRIDGE);
         signalSemaphore(semid, SEM_MUTEX);
+        traceEnd();
+        waitingForBridge = 0;
 
         // Send to captain MSG_ENTER_BRIDGE
         BridgeMsg msg;
         msg.mtype = MSG_ENTER_BRIDGE;
-        msg.pid = myPID;
+        msg.slot = mySlot;
         msg.sequence = -1;
-        if (msgsnd(msq_id, &msg, sizeof(msg) - sizeof(long), 0) == -1) {
-            perror("msgsnd ENTER_BRIDGE");
-        }
+        msg.passengerClass = myClass;
+        msg.retries = retries;
+        msg.gangway = myGangway;
+        sendToCaptain(&msg);
 
+        traceBegin("sequence wait");
         BridgeMsg reply;
-        while (1) {
-            checkSignals(); 
-
-            ssize_t ret = msgrcv(msq_id, &reply, sizeof(reply) - sizeof(long),
-                                MSG_SEQUENCE_REPLY, IPC_NOWAIT);
-            if (ret == -1) {
-                if (errno == ENOMSG) {
-                    // no msg yet
-                    // usleep(10000);
-                    continue;
-                } else {
-                    perror("msgrcv MSG_SEQUENCE_REPLY (IPC_NOWAIT)");
-                }
+        // No end-of-day check while on the bridge: the captain answers every message before
+        // the day ends, and leaving now would keep our place on the bridge counted forever.
+        // Sleeps rather than polls, every gangway adds BRIDGE_CAPACITY passengers waiting here
+        // Sequence reply is addressed to my registry slot
+        while (msgrcv(msq_id, &reply, sizeof(reply) - sizeof(long), myMtype, 0) == -1) {
+            if (errno != EINTR) {
+                perror("msgrcv MSG_SEQUENCE_REPLY");
+                exit(EXIT_FAILURE);
             }
-            // If we got here, that means we received the message
-            break;
         }
 
         mySequence = reply.sequence;
+        traceEnd();
 
 
         // random walking time simulation
@@ -130,19 +259,93 @@ void attemptBoardBridge() {
         if (sm->queueDirection == 1 || sm->shipSailing == 1) {
             // He did, we have to leave
             sm->peopleOnBridge--;
-            signalSemaphore(semid, SEM_MUTEX);
+            sm->peopleOnGangway[myGangway]--;
+            registrySetState(registry, mySlot, REGISTRY_ASHORE);
+            signalTokenAndMutex(semid, SEM_GANGWAY(myGangway));
 
             printf(CYAN "=== Passenger %d ===" RESET " I can't enter the ship, I'm leaving the bridge.\n", myPID);
-
-            signalSemaphore(semid, SEM_BRIDGE);
+            retries++;
             return;
         }
         signalSemaphore(semid, SEM_MUTEX);
 
         attemptBoardShip(currentTrip);
     } else {
-        signalSemaphore(semid, SEM_MUTEX);
-        signalSemaphore(semid, SEM_BRIDGE);
+        signalTokenAndMutex(semid, SEM_GANGWAY(myGangway));
+
+#if PRE_TICKETING
+        // The ship is away or unloading: take a ticket instead of waiting for the bridge to open
+        if (ticketRefusedVoyage != currentTrip) {
+            requestTicket(currentTrip);
+        }
+#endif
+    }
+}
+
+
+int chooseGangway() {
+/*
+  * Picks the gangway with the fewest passengers on it. Ties go to the first one counting from
+  * my PID, so that passengers arriving together spread out. Read without SEM_MUTEX: a stale count only
+  * makes the choice a little worse.
+  *
+  * @return The gangway, 0..sm->gangways-1.
+*/
+
+    int chosen = -1;
+    for (int i = 0; i < sm->gangways; i++) {
+        int g = (myPID + i) % sm->gangways;
+        if (chosen == -1 || sm->peopleOnGangway[g] < sm->peopleOnGangway[chosen]) {
+            chosen = g;
+        }
+    }
+    return chosen;
+}
+
+
+void requestTicket(int currentTrip) {
+/*
+  * Asks the captain for a place in line for the next voyage.
+  * With a ticket, waitForReservationCall() takes over; without one I keep trying the bridge.
+  *
+  * @param currentTrip sm->currentVoyage when I found the bridge closed.
+*/
+
+    BridgeMsg msg;
+    msg.mtype = MSG_TAKE_TICKET;
+    msg.slot = mySlot;
+    msg.sequence = -1;
+    msg.passengerClass = myClass;
+    msg.retries = retries;
+    msg.gangway = 0;
+
+    // Sent only while the day goes on, within the same SEM_MUTEX hold: the captain ends the day
+    // under SEM_MUTEX and then answers every request still queued, so this one gets its reply
+    waitSemaphore(semid, SEM_MUTEX);
+    int sent = !sm->signalEndOfDay && trySendToCaptain(&msg);
+    signalSemaphore(semid, SEM_MUTEX);
+    if (!sent) {
+        ticketRefusedVoyage = currentTrip;
+        return;
+    }
+
+    // Sleeps rather than polls: with pre-ticketing most of the port waits here or for the call
+    BridgeMsg reply;
+    while (msgrcv(msq_id, &reply, sizeof(reply) - sizeof(long), myMtype, 0) == -1) {
+        if (errno != EINTR) {
+            perror("msgrcv myMtype -> ticket");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (reply.sequence == SEQ_TICKETED) {
+        // The captain registered my ticket, he calls me before the bridge opens
+        printf(CYAN "=== Passenger %d ===" RESET " Took a ticket for the next voyage.\n", myPID);
+        traceEnd();
+        waitingForBridge = 0;
+        holdsReservation = 1;
+    } else {
+        ticketRefusedVoyage = currentTrip;
     }
 }
 
@@ -150,66 +353,113 @@ void attemptBoardBridge() {
 void attemptBoardShip(int tripWhenTried) {
     BridgeMsg boardReq;
     boardReq.mtype = MSG_WANT_TO_BOARD;
-    boardReq.pid = myPID;
+    boardReq.slot = mySlot;
     boardReq.sequence = mySequence;
+    boardReq.passengerClass = myClass;
+    boardReq.retries = retries;
+    boardReq.gangway = myGangway;
+    sendToCaptain(&boardReq);
 
-    if (msgsnd(msq_id, &boardReq, sizeof(boardReq) - sizeof(long), 0) == -1) {
-        perror("msgsnd WANT_TO_BOARD");
-    }
-
+    traceBegin("board wait");
     BridgeMsg boardResp;
-    while (1) {
-        ssize_t ret = msgrcv(msq_id, &boardResp, sizeof(boardResp) - sizeof(long),
-                             myPID, IPC_NOWAIT);
-        if (ret == -1) {
-            if (errno == ENOMSG) {
-                // No message (yet) for me.
-                // check if some signal occured
-                checkSignals();
-
-                continue;
-            } else {
-                perror("msgrcv myPID -> boarding response (IPC_NOWAIT)");
-                exit(EXIT_FAILURE);
-            }
+    // The captain answers even at the end of the day
+    while (msgrcv(msq_id, &boardResp, sizeof(boardResp) - sizeof(long), myMtype, 0) == -1) {
+        if (errno != EINTR) {
+            perror("msgrcv myMtype -> boarding response");
+            exit(EXIT_FAILURE);
         }
-        // If we got here, that means we received the message boardResp.
-        break;
     }
 
+    traceEnd();
+
     // sequence >= 0 => OK
     if (boardResp.sequence >= 0) {
-        // Boarding
+        // Boarding, the captain counted us on the ship and gave back our bridge token
         onShip = 1;
-        signalSemaphore(semid, SEM_BRIDGE);
+        myVoyage = tripWhenTried;
+        traceBegin("on ship");
+        if (retries > 0) {
+            printf(CYAN "=== Passenger %d ===" RESET " On board after %d retries.\n", myPID, retries);
+        }
     } else {
-        // sequence == -1 => denial, ship full
+        // sequence < 0 => denial, ship full
         waitSemaphore(semid, SEM_MUTEX);
         sm->peopleOnBridge--;
+        sm->peopleOnGangway[myGangway]--;
+        registrySetState(registry, mySlot, boardResp.sequence == SEQ_DENIED_RESERVED ? REGISTRY_RESERVATION : REGISTRY_ASHORE);
         printf(CYAN "=== Passenger %d ===" RESET " Denied boarding (ship full). Exiting bridge.\n", myPID);
-        signalSemaphore(semid, SEM_MUTEX);
-        signalSemaphore(semid, SEM_BRIDGE);
+        signalTokenAndMutex(semid, SEM_GANGWAY(myGangway));
+        retries++;
+
+        if (boardResp.sequence == SEQ_DENIED_RESERVED) {
+            // Our seat on the next voyage is kept, no need to race for the bridge again
+            holdsReservation = 1;
+        } else {
+            // We already tried and we got denied, so we wait for next voyage
+            lastTripTried = tripWhenTried;
+            waitingForNextArrival = 1;
+        }
+    }
+}
 
-        // We already tried and we got denied, so we wait for next voyage
-        lastTripTried = tripWhenTried;
-        waitingForNextArrival = 1;
+
+void waitForReservationCall() {
+    // Sleeps ashore until the captain calls us with a sequence reserved on this voyage, or sends us home at the end of the day
+    traceBegin("reservation wait");
+    BridgeMsg call;
+    while (msgrcv(msq_id, &call, sizeof(call) - sizeof(long), myMtype, 0) == -1) {
+        if (errno != EINTR) {
+            perror("msgrcv myMtype -> reservation call");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    holdsReservation = 0;
+    traceEnd();
+    if (call.sequence < 0) {
+        checkSignals(); // Dismissed, the day is over
+        return;
     }
+    mySequence = call.sequence;
+    myGangway = call.gangway;
+
+    // The bridge is still closed to everyone else, we cross it first, on the gangway we were called to
+    waitTokenAndMutex(semid, SEM_GANGWAY(myGangway));
+    int currentTrip = sm->currentVoyage;
+    printf(CYAN "=== Passenger %d ===" RESET " Called with a reservation (seq=%d), entering the bridge (gangway %d). PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", myPID, mySequence, myGangway, sm->peopleOnShip, ++(sm->peopleOnBridge));
+    sm->peopleOnGangway[myGangway]++;
+    registrySetState(registry, mySlot, REGISTRY_ON_BRIDGE);
+    signalSemaphore(semid, SEM_MUTEX);
+
+    attemptBoardShip(currentTrip);
 }
 
 
 
+void leaveShipOntoBridge() {
+    // Books my step from the ship onto the lane towards land, SEM_MUTEX held
+    registrySetState(registry, mySlot, REGISTRY_LEAVING);
+    sm->peopleOnShip--;
+    (*landLaneCount)++;
+    if (sm->currentVoyage > myVoyage && sm->peopleToDisembark > 0) {
+        sm->peopleToDisembark--;
+    }
+}
+
+
 void disembarkShip() {
     waitSemaphore(semid, SEM_MUTEX);
     int nowSail = sm->shipSailing;
     int nowQueueDir = sm->queueDirection;
+    int arrived = sm->twoLaneBridge ? sm->currentVoyage > myVoyage : nowQueueDir == 1;
     signalSemaphore(semid, SEM_MUTEX);
 
-    if (nowSail == 0 && nowQueueDir == 1) { // TU COS CHYBA
+    if (nowSail == 0 && arrived) {
         // Can disembark
-        waitSemaphore(semid, SEM_BRIDGE);
-        waitSemaphore(semid, SEM_MUTEX);
-        int peopleOnShip = --(sm->peopleOnShip);
-        int peopleOnBridge = ++(sm->peopleOnBridge);
+        waitTokenAndMutex(semid, landLane);
+        leaveShipOntoBridge();
+        int peopleOnShip = sm->peopleOnShip;
+        int peopleOnBridge = *landLaneCount;
         signalSemaphore(semid, SEM_MUTEX);
 
         printf(CYAN "=== Passenger %d ===" RESET " Disembarking from ship. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE: %d\n", myPID, peopleOnShip, peopleOnBridge);
@@ -220,21 +470,19 @@ void disembarkShip() {
 
         // Successfully disembarked
         waitSemaphore(semid, SEM_MUTEX);
-        printf(CYAN "=== Passenger %d ===" RESET " Left bridge. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE LEFT: %d\n", myPID, sm->peopleOnShip, --(sm->peopleOnBridge));
-        signalSemaphore(semid, SEM_MUTEX);
-
-        signalSemaphore(semid, SEM_BRIDGE);
+        printf(CYAN "=== Passenger %d ===" RESET " Left bridge. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE LEFT: %d\n", myPID, sm->peopleOnShip, --(*landLaneCount));
+        registrySetState(registry, mySlot, REGISTRY_ASHORE);
+        signalTokenAndMutex(semid, landLane);
 
-        shmdt(sm);
-        exit(0);
+        leavePort();
     }
 }
 
 
 void disembarkAfterEndOfDaySignal() {
-    waitSemaphore(semid, SEM_BRIDGE);
-    waitSemaphore(semid, SEM_MUTEX);
-    printf(CYAN "=== Passenger %d ===" RESET " End of day signal received. I'm getting off the ship. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE: %d\n", getpid(), --(sm->peopleOnShip), ++(sm->peopleOnBridge));
+    waitTokenAndMutex(semid, landLane);
+    leaveShipOntoBridge();
+    printf(CYAN "=== Passenger %d ===" RESET " End of day signal received. I'm getting off the ship. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE: %d\n", getpid(), sm->peopleOnShip, *landLaneCount);
     signalSemaphore(semid, SEM_MUTEX);
 
     // simulation of crossing the bridge in disembarking on signal
@@ -242,15 +490,15 @@ void disembarkAfterEndOfDaySignal() {
     // usleep(10000);
 
     waitSemaphore(semid, SEM_MUTEX);
-    printf(CYAN "=== Passenger %d ===" RESET " I left the bridge. Exiting port. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE LEFT: %d\n", getpid(), sm->peopleOnShip, --(sm->peopleOnBridge));
-    signalSemaphore(semid, SEM_MUTEX);
-    signalSemaphore(semid, SEM_BRIDGE); // Free the space on the bridge
+    printf(CYAN "=== Passenger %d ===" RESET " I left the bridge. Exiting port. PEOPLE ON SHIP LEFT: %d, PEOPLE ON BRIDGE LEFT: %d\n", getpid(), sm->peopleOnShip, --(*landLaneCount));
+    registrySetState(registry, mySlot, REGISTRY_ASHORE);
+    signalTokenAndMutex(semid, landLane); // Free the space on the bridge
 
-    shmdt(sm);
-    exit(0);
+    leavePort();
 }
 
 void waitForShipToReturn() {
+    traceBegin("ashore");
     while (1) {
         checkSignals(); 
         waitSemaphore(semid, SEM_MUTEX);
@@ -261,5 +509,16 @@ void waitForShipToReturn() {
             waitingForNextArrival = 0;
             break;
         }
+        // The gate closes when the ship leaves and opens once it is back, or at the end of the day
+        waitBoardingGateOpen(semid);
     }
-}
\ No newline at end of file
+    traceEnd();
+}
+
+
+void leavePort() {
+    // Gives back my registry slot and ends the process
+    registryRelease(registry, mySlot);
+    detachSharedMemory();
+    exit(0);
+}
@@ -1,8 +1,16 @@
 // Function prototypes
 void initialize(int argc, char *argv[]);
+int drawPassengerClass();
+void sendToCaptain(BridgeMsg *msg);
+int trySendToCaptain(BridgeMsg *msg);
 void checkSignals();
 void attemptBoardBridge();
+int chooseGangway();
+void requestTicket(int currentTrip);
 void attemptBoardShip(int tripWhenTried);
+void leaveShipOntoBridge();
 void disembarkShip();
 void disembarkAfterEndOfDaySignal();
-void waitForShipToReturn();
\ No newline at end of file
+void waitForShipToReturn();
+void waitForReservationCall();
+void leavePort();
\ No newline at end of file
@@ -0,0 +1,521 @@
+#include "utils.h"
+#include "bridge_queue.h"
+#include "request_ring.h"
+#include "passengerEngine.h"
+
+/*
+ * Passenger engine (rejs -E): drives every passenger of the day from one thread instead of
+ * one process each. A passenger is a 16-byte record in a flat array, stepping through the
+ * same cycle as passenger.c (bridge, sequence wait, board wait, on ship, ashore, reservation)
+ * when the ship captain's replies arrive on the reply ring or the shared state changes.
+ * Records waiting for the same thing are chained into FIFOs, so each step only touches the
+ * passengers it concerns, and all steps of a pass share one SEM_MUTEX hold.
+ *
+ * Records are not in the passenger registry, which is sized for processes: their slot in the
+ * bridge protocol is PASSENGER_ENGINE_ID_BASE + record index, and the captain routes replies
+ * to those slots over the reply ring instead of the message queue. rejs keeps the arrival
+ * schedule and lets passengers arrive by raising sm->passengersArrived.
+ *
+ * Usage: passengerEngine <regionFd> <semid> <passengers>
+*/
+
+int regionFd, semid, msq_id;
+SharedMemory *sm;
+RequestRing *requestRing; // NULL when requests go over the SysV queue
+RequestRing *replyRing;
+
+EnginePassenger *passengers;
+int passengerCount, admitted, remaining;
+EngineList bridgeQueue, outbox, onShip, ashore, called;
+int lastVoyage, endOfDayHandled;
+int bridgeTokensToRelease[MAX_GANGWAYS];
+long long events, sleeps, strayReplies, boarded, denied, startNs;
+
+
+int main(int argc, char *argv[]) {
+    initialize(argc, argv);
+    runEngine();
+    printEngineSummary();
+
+    detachSharedMemory();
+    free(passengers);
+    return 0;
+}
+
+
+void initialize(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, RED "Usage: %s <regionFd> <semid> <passengers>" RESET "\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    srand(time(NULL) ^ getpid());
+
+    regionFd = atoi(argv[1]);
+    semid = atoi(argv[2]);
+    passengerCount = atoi(argv[3]);
+
+    sm = attachSharedMemory(regionFd);
+    replyRing = attachSharedSection(SECTION_REPLY_RING);
+    if (sm->requestTransport == REQUEST_TRANSPORT_RING) {
+        requestRing = attachSharedSection(SECTION_REQUEST_RING);
+    }
+
+    msq_id = msgget(BRIDGE_QUEUE_KEY, 0);
+    if (msq_id == -1) {
+        perror("msgget passengerEngine");
+        exit(EXIT_FAILURE);
+    }
+
+    passengers = calloc(passengerCount > 0 ? passengerCount : 1, sizeof(EnginePassenger));
+    if (passengers == NULL) {
+        perror(RED "calloc passenger records" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    EngineList empty = {-1, -1, 0};
+    bridgeQueue = outbox = onShip = ashore = called = empty;
+    remaining = passengerCount;
+    lastVoyage = -1;
+
+    printf(CYAN "=== Passenger engine ===" RESET " Driving %d passengers from one thread, %zu B per passenger.\n", passengerCount, sizeof(EnginePassenger));
+    reportReady(sm, semid, ROLE_PASSENGER_ENGINE);
+}
+
+
+static void listPush(EngineList *list, int index) {
+    passengers[index].next = -1;
+    if (list->tail == -1) {
+        list->head = index;
+    } else {
+        passengers[list->tail].next = index;
+    }
+    list->tail = index;
+    list->length++;
+}
+
+
+static int listPop(EngineList *list) {
+    int index = list->head;
+    list->head = passengers[index].next;
+    if (list->head == -1) {
+        list->tail = -1;
+    }
+    list->length--;
+    return index;
+}
+
+
+static void finish(int index) {
+    // The passenger leaves the port
+    passengers[index].state = ENGINE_DONE;
+    remaining--;
+    events++;
+}
+
+
+void runEngine() {
+/*
+  * Steps the passengers until all of them have left the port.
+  * Each pass drains the reply ring, then handles the replies and whatever the shared state
+  * allows under one SEM_MUTEX hold, sends the requests that came out of it and sleeps on
+  * the reply ring if nothing happened.
+*/
+
+    BridgeMsg replies[ENGINE_BATCH];
+
+    startNs = getMonotonicTimeNs();
+    while (remaining > 0) {
+        long long eventsBefore = events;
+
+        int count = 0;
+        while (count < ENGINE_BATCH && requestRingPop(replyRing, &replies[count])) {
+            count++;
+        }
+
+        waitSemaphore(semid, SEM_MUTEX);
+        admitArrivals();
+        for (int i = 0; i < count; i++) {
+            handleReply(&replies[i]);
+        }
+        if (sm->signalEndOfDay && !endOfDayHandled) {
+            endOfDay();
+        }
+        if (sm->currentVoyage != lastVoyage) {
+            returnAshorePassengers();
+        }
+        enterBridge();
+        crossCalledPassengers();
+        disembarkPassengers();
+        for (int g = 0; g < sm->gangways; g++) {
+            releaseTokens(SEM_GANGWAY(g), bridgeTokensToRelease[g]);
+            bridgeTokensToRelease[g] = 0;
+        }
+        signalSemaphore(semid, SEM_MUTEX);
+
+        flushOutbox();
+
+        if (events == eventsBefore && remaining > 0 && requestRingWait(replyRing, ENGINE_WAIT_US)) {
+            sleeps++;
+        }
+    }
+}
+
+
+void admitArrivals() {
+    // Passengers rejs has let arrive since the last pass join the end of the bridge queue, SEM_MUTEX held
+    int arrived = sm->passengersArrived < passengerCount ? sm->passengersArrived : passengerCount;
+
+    while (admitted < arrived) {
+        passengers[admitted].passengerClass = drawPassengerClass();
+        passengers[admitted].sequence = -1;
+        events++;
+        waitAshore(admitted++, ENGINE_BRIDGE_WAIT);
+    }
+}
+
+
+int drawPassengerClass() {
+    // Draws the boarding class according to CLASS_SHARE_PERCENT, like passenger.c
+    int shares[] = CLASS_SHARE_PERCENT;
+    int roll = rand() % 100;
+
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        if (roll < shares[c]) {
+            return c;
+        }
+        roll -= shares[c];
+    }
+    return CLASS_STANDARD;
+}
+
+
+void waitAshore(int index, int state) {
+/*
+  * Puts a passenger ashore to wait: for the bridge, for the next arrival or for a
+  * reservation call. After the end of day it leaves the port instead. SEM_MUTEX held.
+  *
+  * @param state ENGINE_BRIDGE_WAIT, ENGINE_ASHORE or ENGINE_RESERVATION_WAIT.
+*/
+
+    EnginePassenger *passenger = &passengers[index];
+
+    if (sm->signalEndOfDay) {
+        finish(index);
+        return;
+    }
+
+    // Denied for a voyage that has already left: straight back to the bridge
+    if (state == ENGINE_ASHORE && sm->currentVoyage > passenger->voyage) {
+        state = ENGINE_BRIDGE_WAIT;
+    }
+
+    passenger->state = state;
+    if (state == ENGINE_BRIDGE_WAIT) {
+        listPush(&bridgeQueue, index);
+    } else if (state == ENGINE_ASHORE) {
+        listPush(&ashore, index);
+    }
+}
+
+
+void handleReply(const BridgeMsg *reply) {
+/*
+  * Steps the passenger a captain's reply is addressed to, as passenger.c does when its
+  * msgrcv() returns. SEM_MUTEX held.
+*/
+
+    int index = reply->slot - PASSENGER_ENGINE_ID_BASE;
+    if (index < 0 || index >= passengerCount) {
+        strayReplies++;
+        return;
+    }
+
+    EnginePassenger *passenger = &passengers[index];
+
+    switch (passenger->state) {
+        case ENGINE_SEQUENCE_WAIT:
+            passenger->sequence = reply->sequence;
+
+            // The captain may have turned the bridge around while we were walking
+            if (sm->queueDirection == 1 || sm->shipSailing == 1) {
+                sm->peopleOnBridge--;
+                sm->peopleOnGangway[passenger->gangway]--;
+                bridgeTokensToRelease[passenger->gangway]++;
+                if (passenger->retries < 255) passenger->retries++;
+                waitAshore(index, ENGINE_BRIDGE_WAIT);
+            } else {
+                passenger->state = ENGINE_BOARD_WAIT;
+                listPush(&outbox, index);
+            }
+            break;
+
+        case ENGINE_BOARD_WAIT:
+            bridgeTokensToRelease[passenger->gangway]++;
+            if (reply->sequence >= 0) {
+                passenger->state = ENGINE_ON_SHIP;
+                listPush(&onShip, index);
+                boarded++;
+            } else {
+                sm->peopleOnBridge--;
+                sm->peopleOnGangway[passenger->gangway]--;
+                denied++;
+                if (passenger->retries < 255) passenger->retries++;
+                waitAshore(index, reply->sequence == SEQ_DENIED_RESERVED ? ENGINE_RESERVATION_WAIT : ENGINE_ASHORE);
+            }
+            break;
+
+        case ENGINE_RESERVATION_WAIT:
+            passenger->sequence = reply->sequence;
+            passenger->gangway = reply->gangway >= 0 && reply->gangway < sm->gangways ? reply->gangway : 0;
+            passenger->state = ENGINE_CALLED;
+            listPush(&called, index);
+            break;
+
+        default:
+            // A reservation call for a passenger that already went home at the end of the day
+            strayReplies++;
+            return;
+    }
+    events++;
+}
+
+
+void enterBridge() {
+/*
+  * Lets the passengers at the head of the bridge queue onto the bridge while it is turned
+  * towards the ship, as many as there is room for, each onto the gangway with the fewest
+  * passengers at that moment. SEM_MUTEX held.
+*/
+
+    if (sm->queueDirection != 0 || sm->shipSailing || bridgeQueue.length == 0) {
+        return;
+    }
+
+    // Nobody else takes gangway tokens while we hold SEM_MUTEX, so the room counted here is there
+    int wanted = bridgeQueue.length < ENGINE_BATCH ? bridgeQueue.length : ENGINE_BATCH;
+    int room[MAX_GANGWAYS], load[MAX_GANGWAYS], taking[MAX_GANGWAYS] = {0};
+    for (int g = 0; g < sm->gangways; g++) {
+        room[g] = tokensAvailable(SEM_GANGWAY(g));
+        load[g] = sm->peopleOnGangway[g];
+    }
+    for (int i = 0; i < wanted; i++) {
+        int chosen = -1;
+        for (int g = 0; g < sm->gangways; g++) {
+            if (taking[g] < room[g] && (chosen == -1 || load[g] < load[chosen])) {
+                chosen = g;
+            }
+        }
+        if (chosen == -1) {
+            break;
+        }
+        taking[chosen]++;
+        load[chosen]++;
+    }
+
+    for (int g = 0; g < sm->gangways; g++) {
+        int entering = takeTokens(SEM_GANGWAY(g), taking[g]);
+        for (int i = 0; i < entering; i++) {
+            int index = listPop(&bridgeQueue);
+            passengers[index].state = ENGINE_SEQUENCE_WAIT;
+            passengers[index].voyage = sm->currentVoyage;
+            passengers[index].gangway = g;
+            sm->peopleOnBridge++;
+            sm->peopleOnGangway[g]++;
+            listPush(&outbox, index);
+            events++;
+        }
+    }
+}
+
+
+void crossCalledPassengers() {
+/*
+  * Walks the passengers called with a reservation onto the bridge, each on the gangway it was
+  * called to, in call order. The captain calls no more of them than a gangway holds, and nobody
+  * else may enter meanwhile. SEM_MUTEX held.
+*/
+
+    for (int i = 0; i < ENGINE_BATCH && called.length > 0; i++) {
+        EnginePassenger *passenger = &passengers[called.head];
+        if (takeTokens(SEM_GANGWAY(passenger->gangway), 1) == 0) {
+            break;
+        }
+
+        int index = listPop(&called);
+        passenger->state = ENGINE_BOARD_WAIT;
+        passenger->voyage = sm->currentVoyage;
+        sm->peopleOnBridge++;
+        sm->peopleOnGangway[passenger->gangway]++;
+        listPush(&outbox, index);
+        events++;
+    }
+}
+
+
+void disembarkPassengers() {
+/*
+  * Lets the passengers of the voyages that have arrived off the ship, oldest voyage first,
+  * or everybody at the end of the day. Crossing the bridge takes no time, so a passenger steps
+  * onto the lane towards land and off it again within this critical section. SEM_MUTEX held.
+*/
+
+    int left = 0;
+    while (onShip.length > 0 && left < ENGINE_BATCH) {
+        EnginePassenger *passenger = &passengers[onShip.head];
+        int arrived = sm->twoLaneBridge ? sm->currentVoyage > passenger->voyage : sm->queueDirection == 1;
+        if (!sm->signalEndOfDay && (sm->shipSailing || !arrived)) {
+            break; // Boarded in voyage order, nobody behind can leave either
+        }
+
+        sm->peopleOnShip--;
+        if (sm->currentVoyage > passenger->voyage && sm->peopleToDisembark > 0) {
+            sm->peopleToDisembark--;
+        }
+        finish(listPop(&onShip));
+        left++;
+    }
+}
+
+
+void returnAshorePassengers() {
+    // The ship is back: passengers denied for an earlier voyage queue for the bridge again, SEM_MUTEX held
+    lastVoyage = sm->currentVoyage;
+
+    EngineList waiting = ashore;
+    ashore.head = ashore.tail = -1;
+    ashore.length = 0;
+
+    while (waiting.length > 0) {
+        int index = listPop(&waiting);
+        waitAshore(index, ENGINE_ASHORE);
+        events++;
+    }
+}
+
+
+void endOfDay() {
+/*
+  * Sends home everybody ashore, as checkSignals() does in passenger.c. Passengers on the
+  * bridge wait for the captain's answer, those on the ship disembark, and passengers who
+  * have not arrived yet will not come. SEM_MUTEX held.
+*/
+
+    endOfDayHandled = 1;
+
+    for (int index = 0; index < admitted; index++) {
+        int state = passengers[index].state;
+        if (state == ENGINE_BRIDGE_WAIT || state == ENGINE_ASHORE || state == ENGINE_RESERVATION_WAIT || state == ENGINE_CALLED) {
+            finish(index);
+        }
+    }
+    bridgeQueue.head = bridgeQueue.tail = ashore.head = ashore.tail = called.head = called.tail = -1;
+    bridgeQueue.length = ashore.length = called.length = 0;
+
+    remaining -= passengerCount - admitted;
+    admitted = passengerCount;
+}
+
+
+int flushOutbox() {
+/*
+  * Sends the requests of the last pass to the captain, without blocking: whatever does not
+  * fit in the request ring or the message queue waits for the next pass.
+  *
+  * @return Number of requests sent.
+*/
+
+    int sent = 0;
+
+    while (outbox.length > 0) {
+        EnginePassenger *passenger = &passengers[outbox.head];
+        BridgeMsg msg;
+        msg.mtype = passenger->state == ENGINE_SEQUENCE_WAIT ? MSG_ENTER_BRIDGE : MSG_WANT_TO_BOARD;
+        msg.slot = PASSENGER_ENGINE_ID_BASE + outbox.head;
+        msg.generation = 0;
+        msg.sequence = passenger->state == ENGINE_SEQUENCE_WAIT ? -1 : passenger->sequence;
+        msg.passengerClass = passenger->passengerClass;
+        msg.retries = passenger->retries;
+        msg.gangway = passenger->gangway;
+        msg.sentAtNs = getMonotonicTimeNs();
+
+        if (requestRing != NULL) {
+            if (!requestRingPush(requestRing, &msg)) {
+                break;
+            }
+        } else if (msgsnd(msq_id, &msg, sizeof(msg) - sizeof(long), IPC_NOWAIT) == -1) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            perror("msgsnd passengerEngine");
+        }
+
+        listPop(&outbox);
+        sent++;
+    }
+    return sent;
+}
+
+
+int tokensAvailable(int sem) {
+    int available = semctl(semid, sem, GETVAL);
+    if (available == -1) {
+        perror(RED "semctl GETVAL passengerEngine" RESET);
+        exit(EXIT_FAILURE);
+    }
+    return available;
+}
+
+
+int takeTokens(int sem, int wanted) {
+/*
+  * Takes up to wanted units of a bridge semaphore without waiting. SEM_MUTEX held.
+  *
+  * @return Units taken, 0 if the bridge is full.
+*/
+
+    int available = tokensAvailable(sem);
+    int taking = wanted < available ? wanted : available;
+    if (taking <= 0) {
+        return 0;
+    }
+
+    struct sembuf operation = {sem, -taking, IPC_NOWAIT};
+    if (semop(semid, &operation, 1) == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+        perror(RED "semop take passengerEngine" RESET);
+        exit(EXIT_FAILURE);
+    }
+    return taking;
+}
+
+
+void releaseTokens(int sem, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    struct sembuf operation = {sem, count, 0};
+    while (semop(semid, &operation, 1) == -1) {
+        if (errno != EINTR) {
+            perror(RED "semop release passengerEngine" RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+void printEngineSummary() {
+    double seconds = (getMonotonicTimeNs() - startNs) / 1e9;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf(CYAN "=== Passenger engine ===" RESET " %d passengers: %zu B of state each (%.1f KiB in total), %.0f B resident per passenger.\n",
+           passengerCount, sizeof(EnginePassenger), passengerCount * sizeof(EnginePassenger) / 1024.0,
+           passengerCount > 0 ? usage.ru_maxrss * 1024.0 / passengerCount : 0);
+    double cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    printf(CYAN "=== Passenger engine ===" RESET " %lld events in %.1f s (%.0f/s, %.0f per CPU second), %lld boarded, %lld denied, %lld sleeps on the reply ring, %lld stray replies.\n",
+           events, seconds, seconds > 0 ? events / seconds : 0, cpuSeconds > 0 ? events / cpuSeconds : 0, boarded, denied, sleeps, strayReplies);
+}
@@ -0,0 +1,51 @@
+#ifndef PASSENGER_ENGINE_H
+#define PASSENGER_ENGINE_H
+
+#define ENGINE_BATCH 256     // Records handled per SEM_MUTEX hold and replies per drain
+#define ENGINE_WAIT_US 1000  // Longest sleep on an empty reply ring, keeps polling the shared state
+
+// Where a passenger is in the cycle of passenger.c
+#define ENGINE_NOT_ARRIVED 0
+#define ENGINE_BRIDGE_WAIT 1       // Ashore, wants onto the bridge (attemptBoardBridge)
+#define ENGINE_SEQUENCE_WAIT 2     // On the bridge, MSG_ENTER_BRIDGE sent
+#define ENGINE_BOARD_WAIT 3        // On the bridge, MSG_WANT_TO_BOARD sent
+#define ENGINE_ON_SHIP 4           // Boarded, waiting to disembark
+#define ENGINE_ASHORE 5            // Denied, waiting for the next arrival (waitForShipToReturn)
+#define ENGINE_RESERVATION_WAIT 6  // Denied with a reservation, waiting to be called
+#define ENGINE_CALLED 7            // Called with a reservation, waiting for room on the bridge
+#define ENGINE_DONE 8              // Left the port
+
+// One passenger, 16 bytes
+typedef struct {
+    unsigned char state;          // ENGINE_*
+    unsigned char passengerClass;
+    unsigned char retries;        // Saturates at 255
+    unsigned char gangway;        // Gangway towards the ship, while on the bridge or called
+    int sequence;
+    int voyage;                   // sm->currentVoyage when entering the bridge, kept as the voyage boarded or denied for
+    int next;                     // Next record on the list it is on, -1 = last
+} EnginePassenger;
+
+// Intrusive FIFO of records linked through EnginePassenger.next
+typedef struct {
+    int head, tail, length;
+} EngineList;
+
+void initialize(int argc, char *argv[]);
+void runEngine();
+void admitArrivals();
+int drawPassengerClass();
+void handleReply(const BridgeMsg *reply);
+void waitAshore(int index, int state);
+void enterBridge();
+void crossCalledPassengers();
+void disembarkPassengers();
+void returnAshorePassengers();
+void endOfDay();
+int flushOutbox();
+int tokensAvailable(int sem);
+int takeTokens(int sem, int wanted);
+void releaseTokens(int sem, int count);
+void printEngineSummary();
+
+#endif
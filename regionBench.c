@@ -0,0 +1,148 @@
+#define _GNU_SOURCE
+#include "utils.h"
+#include "shared_region.h"
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/*
+ * Compares the SysV shared memory path with the memfd shared region (with and without huge pages):
+ * time to create and attach a region, time to touch every page once,
+ * and dTLB misses of a random-access pass over the whole region.
+ *
+ * Usage: regionBench [sizeMiB ...]   (default: 16 64 256)
+*/
+
+#define RANDOM_ACCESSES 4000000
+
+enum { BACKEND_SYSV, BACKEND_MEMFD, BACKEND_MEMFD_HUGE };
+static const char *backendNames[] = {"sysv", "memfd", "memfd+huge"};
+
+
+int openTlbMissCounter() {
+/*
+  * Opens a perf counter of data TLB read misses of this process.
+  *
+  * @return The counter's file descriptor, or -1 if perf events are not available.
+*/
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+
+void* attachBackend(int backend, size_t size, int *handle) {
+/*
+  * Creates and attaches a region of the given size with one of the backends.
+  *
+  * @return The attached memory, or NULL if the backend is not available.
+*/
+
+    if (backend == BACKEND_SYSV) {
+        *handle = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+        if (*handle == -1) return NULL;
+        void *memory = shmat(*handle, NULL, 0);
+        return memory == (void *)-1 ? NULL : memory;
+    }
+
+    int hugePages = backend == BACKEND_MEMFD_HUGE;
+    *handle = memfd_create("rejs-bench", hugePages ? MFD_HUGETLB : 0);
+    if (*handle == -1 || ftruncate(*handle, size) == -1) return NULL;
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *handle, 0);
+    return memory == MAP_FAILED ? NULL : memory;
+}
+
+
+void detachBackend(int backend, void *memory, size_t size, int handle) {
+    if (backend == BACKEND_SYSV) {
+        shmdt(memory);
+        shmctl(handle, IPC_RMID, NULL);
+    } else {
+        munmap(memory, size);
+        close(handle);
+    }
+}
+
+
+void runBackend(int backend, size_t size, int tlbCounter) {
+/*
+  * Measures one backend at one region size and prints a result row.
+*/
+
+    int handle = -1;
+    long long start = getMonotonicTimeNs();
+    volatile char *memory = attachBackend(backend, size, &handle);
+    long long attachNs = getMonotonicTimeNs() - start;
+
+    if (memory == NULL) {
+        printf("%-11s %8zu  unavailable (%s)\n", backendNames[backend], size >> 20, strerror(errno));
+        if (handle != -1 && backend != BACKEND_SYSV) close(handle);
+        return;
+    }
+
+    long pageSize = sysconf(_SC_PAGESIZE);
+    start = getMonotonicTimeNs();
+    for (size_t offset = 0; offset < size; offset += pageSize) {
+        memory[offset] = 1;
+    }
+    long long touchNs = getMonotonicTimeNs() - start;
+
+    unsigned long long index = 88172645463325252ULL;
+    long long misses = -1;
+    if (tlbCounter != -1) {
+        ioctl(tlbCounter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(tlbCounter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    start = getMonotonicTimeNs();
+    for (int i = 0; i < RANDOM_ACCESSES; i++) {
+        index ^= index << 13;
+        index ^= index >> 7;
+        index ^= index << 17;
+        memory[index % size]++;
+    }
+    long long randomNs = getMonotonicTimeNs() - start;
+    if (tlbCounter != -1) {
+        ioctl(tlbCounter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(tlbCounter, &misses, sizeof(misses)) != sizeof(misses)) misses = -1;
+    }
+
+    printf("%-11s %8zu %12.1f %12.2f %14.1f", backendNames[backend], size >> 20, attachNs / 1e3, touchNs / 1e6, (double)randomNs / RANDOM_ACCESSES);
+    if (misses >= 0) {
+        printf(" %14lld\n", misses);
+    } else {
+        printf(" %14s\n", "n/a");
+    }
+
+    detachBackend(backend, (void *)memory, size, handle);
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t defaultSizes[] = {16, 64, 256};
+    int sizeCount = argc > 1 ? argc - 1 : 3;
+
+    int tlbCounter = openTlbMissCounter();
+    if (tlbCounter == -1) {
+        fprintf(stderr, YELLOW "perf events unavailable (%s), TLB misses not measured." RESET "\n", strerror(errno));
+    }
+
+    printf("%-11s %8s %12s %12s %14s %14s\n", "backend", "size_MiB", "attach_us", "touch_ms", "random_ns_op", "dtlb_misses");
+    for (int i = 0; i < sizeCount; i++) {
+        size_t size = (argc > 1 ? strtoul(argv[i + 1], NULL, 10) : defaultSizes[i]) << 20;
+        for (int backend = BACKEND_SYSV; backend <= BACKEND_MEMFD_HUGE; backend++) {
+            runBackend(backend, size, tlbCounter);
+        }
+    }
+
+    if (tlbCounter != -1) close(tlbCounter);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include "utils.h"
+#include "registry.h"
+
+/*
+ * Passenger registry: a fixed slab of slots in the shared region, one per passenger process.
+ * A passenger claims a slot when it arrives and keeps it until it leaves the port; the slot
+ * index is its address in the bridge protocol (BridgeMsg.slot, replies with mtype
+ * MSG_REPLY_BASE + slot). Free slots form a lock-free stack, and every state change is a
+ * single atomic store by the slot's owner, so none of it takes SEM_MUTEX.
+*/
+
+
+static unsigned long long packHead(unsigned long long tag, int slot) {
+    return (tag << 32) | (unsigned int)(slot + 1);
+}
+
+
+void initializeRegistry(PassengerRegistry *registry) {
+/*
+  * Puts every slot on the free list, lowest index first. Called by rejs before any passenger starts.
+*/
+
+    for (int i = 0; i < REGISTRY_SLOTS; i++) {
+        atomic_init(&registry->slots[i].state, REGISTRY_FREE);
+        atomic_init(&registry->slots[i].sequence, -1);
+        atomic_init(&registry->slots[i].next, i + 1 < REGISTRY_SLOTS ? i + 1 : -1);
+        atomic_init(&registry->slots[i].generation, 0);
+        atomic_init(&registry->slots[i].stateSinceNs, 0);
+    }
+    atomic_init(&registry->freeHead, packHead(0, 0));
+    atomic_init(&registry->claimed, 0);
+    atomic_init(&registry->claimFailures, 0);
+}
+
+
+int registryClaim(PassengerRegistry *registry, pid_t pid, int passengerClass) {
+/*
+  * Takes a free slot for an arriving passenger, in state REGISTRY_ASHORE.
+  *
+  * @return The slot, or -1 if the registry is full.
+*/
+
+    unsigned long long head = atomic_load(&registry->freeHead);
+    int slot;
+
+    while (1) {
+        slot = (int)(head & 0xffffffffULL) - 1;
+        if (slot < 0) {
+            atomic_fetch_add(&registry->claimFailures, 1);
+            return -1;
+        }
+        int next = atomic_load(&registry->slots[slot].next);
+        if (atomic_compare_exchange_weak(&registry->freeHead, &head, packHead((head >> 32) + 1, next))) {
+            break;
+        }
+    }
+
+    RegistrySlot *entry = &registry->slots[slot];
+    long long nowNs = getMonotonicTimeNs();
+    entry->pid = pid;
+    entry->passengerClass = passengerClass;
+    entry->claimedAtNs = nowNs;
+    entry->voyage = -1;
+    entry->gangway = 0;
+    atomic_store(&entry->sequence, -1);
+    atomic_store(&entry->stateSinceNs, nowNs);
+    atomic_store(&entry->state, REGISTRY_ASHORE);
+    atomic_fetch_add(&registry->claimed, 1);
+    return slot;
+}
+
+
+void registryRelease(PassengerRegistry *registry, int slot) {
+/*
+  * Gives a slot back when its passenger leaves the port, or when the captain reclaims it from
+  * a passenger that died. Requests still carrying the old generation are ignored from now on.
+*/
+
+    RegistrySlot *entry = &registry->slots[slot];
+    atomic_fetch_add(&entry->generation, 1);
+    atomic_store(&entry->state, REGISTRY_FREE);
+    atomic_fetch_sub(&registry->claimed, 1);
+
+    unsigned long long head = atomic_load(&registry->freeHead);
+    do {
+        atomic_store(&entry->next, (int)(head & 0xffffffffULL) - 1);
+    } while (!atomic_compare_exchange_weak(&registry->freeHead, &head, packHead((head >> 32) + 1, slot)));
+}
+
+
+void registrySetState(PassengerRegistry *registry, int slot, int state) {
+    // Records a state change of the slot's passenger
+    atomic_store(&registry->slots[slot].stateSinceNs, getMonotonicTimeNs());
+    atomic_store(&registry->slots[slot].state, state);
+}
+
+
+int registryCensus(const PassengerRegistry *registry, int counts[REGISTRY_STATES]) {
+/*
+  * Counts the passengers in each state with one pass over the slab. Slots are read one at
+  * a time without locking, so a passenger changing state meanwhile may be counted in either.
+  *
+  * @param counts Receives the number of slots per REGISTRY_* state.
+  * @return Passengers registered (all states but REGISTRY_FREE).
+*/
+
+    memset(counts, 0, REGISTRY_STATES * sizeof(int));
+    for (int i = 0; i < REGISTRY_SLOTS; i++) {
+        int state = atomic_load_explicit(&registry->slots[i].state, memory_order_relaxed);
+        if (state >= 0 && state < REGISTRY_STATES) counts[state]++;
+    }
+    return REGISTRY_SLOTS - counts[REGISTRY_FREE];
+}
@@ -0,0 +1,48 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define REGISTRY_SLOTS 8192 // Passenger processes present at the same time
+
+// States of a registry slot, written by the passenger holding it under SEM_MUTEX together with the
+// count it stands for; the captain writes REGISTRY_ON_SHIP when it boards a passenger
+#define REGISTRY_FREE 0
+#define REGISTRY_ASHORE 1      // Waiting for the bridge or for the next voyage
+#define REGISTRY_ON_BRIDGE 2   // On the bridge, towards the ship: counted in sm->peopleOnBridge
+#define REGISTRY_ON_SHIP 3     // Counted in sm->peopleOnShip
+#define REGISTRY_RESERVATION 4 // Ashore, holding a seat reserved on the next voyage
+#define REGISTRY_LEAVING 5     // Disembarking: counted on the lane towards land
+#define REGISTRY_STATES 6
+#define REGISTRY_STATE_NAMES {"free", "ashore", "bridge", "ship", "reserved", "leaving"}
+
+// One passenger process
+typedef struct {
+    atomic_int state;          // REGISTRY_*, published last when a slot is claimed
+    pid_t pid;
+    int passengerClass;
+    atomic_int sequence;       // Last sequence the captain assigned, -1 = none
+    atomic_int next;           // Next free slot while on the free list
+    atomic_int generation;     // Bumped on release, requests carry it so a dead passenger's are told apart
+    long long claimedAtNs;     // Monotonic time the passenger arrived
+    atomic_llong stateSinceNs; // Monotonic time of the last state change
+    int voyage;                // sm->currentVoyage the passenger boarded on, set by the captain
+    int gangway;               // Gangway the passenger crosses on, valid while on the bridge or called
+} RegistrySlot;
+
+// Passenger registry, the "registry" section of the shared region
+typedef struct {
+    atomic_ullong freeHead;    // (tag << 32) | (first free slot + 1), the tag defeats ABA
+    atomic_int claimed;        // Slots in use
+    atomic_int claimFailures;  // Passengers turned away with the registry full
+    RegistrySlot slots[REGISTRY_SLOTS];
+} PassengerRegistry;
+
+void initializeRegistry(PassengerRegistry *registry);
+int registryClaim(PassengerRegistry *registry, pid_t pid, int passengerClass);
+void registryRelease(PassengerRegistry *registry, int slot);
+void registrySetState(PassengerRegistry *registry, int slot, int state);
+int registryCensus(const PassengerRegistry *registry, int counts[REGISTRY_STATES]);
+
+#endif
@@ -1,10 +1,28 @@
+#define _GNU_SOURCE
 #include "utils.h"
 #include "bridge_queue.h"
+#include "checkpoint.h"
+#include "trace.h"
+#include "departure.h"
+#include "arrival.h"
+#include "request_ring.h"
+#include "registry.h"
+#include <sched.h>
 
-#define NUM_PASSENGERS 1000
+#define NUM_PASSENGERS 1000 // Default, can be changed with -p
 
-int shmid, semid, msq_id;
+// Where and how a process role runs, set with the -C/-N/-F, -H and -P options
+typedef struct {
+    int pinned;
+    cpu_set_t cpus;
+    int niceSet, nice;
+    int fifoPriority; // 0 = keep the normal time-sharing policy
+} Placement;
+
+int regionFd, semid, msq_id;
 SharedMemory *sm;
+pid_t shipCaptainPid;
+struct rusage captainUsage; // Filled in when the ship captain is reaped
 
 
 void signalHandler(int sig) {
@@ -15,26 +33,284 @@ void signalHandler(int sig) {
     */
     if (sig == SIGINT) {
         if (sm != NULL) {
-            shmdt(sm);
+            detachSharedMemory();
         }
 
-        cleanupSharedMemory(shmid);
+        cleanupSharedMemory(regionFd);
         cleanupSemaphores(semid);
         if (msgctl(msq_id, IPC_RMID, NULL) == -1) {
             perror("msgctl IPC_RMID");
         }
-        unlink(FIFO_PATH); // Delete FIFO file
+        unlink(CONTROL_SOCKET_PATH);
         unlink(FIFO_PATH_PASSENGERS); // Delete FIFO file
+        unlink(REGION_INFO_PATH);
         printf(GREEN "Cleanup complete, exiting.\n" RESET);
         exit(0);
     } else if (sig == SIGCHLD) {
         // Zombie process handling
-        while (waitpid(-1, NULL, WNOHANG) > 0);
+        struct rusage usage;
+        pid_t pid;
+        while ((pid = wait4(-1, NULL, WNOHANG, &usage)) > 0) {
+            if (pid == shipCaptainPid) captainUsage = usage;
+        }
+    }
+}
+
+
+void publishRegionInfo(int regionFd) {
+    /*
+    * Writes where the shared region can be found, so monitors such as rejs-top
+    * can open it through /proc/<pid>/fd/<fd> without being started by rejs.
+    */
+    FILE *info = fopen(REGION_INFO_PATH, "w");
+    if (info == NULL) {
+        perror(YELLOW "fopen region info" RESET);
+        return;
+    }
+    fprintf(info, "%d %d\n", getpid(), regionFd);
+    fclose(info);
+}
+
+
+void parseCpuList(const char *text, cpu_set_t *cpus) {
+    /*
+    * Parses a CPU list such as "2", "2-3" or "0,4-7".
+    */
+    CPU_ZERO(cpus);
+    const char *p = text;
+    while (*p != '\0') {
+        char *end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0) break;
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) break;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, cpus);
+        p = *end == ',' ? end + 1 : end;
+        if (*end == '\0') return;
+    }
+    fprintf(stderr, RED "Bad CPU list \"%s\"." RESET "\n", text);
+    exit(EXIT_FAILURE);
+}
+
+
+void applyPlacement(const Placement *placement, const char *role) {
+    /*
+    * Applies a role's CPU set and scheduling settings to the calling process. Called in the
+    * child between fork and exec, so they carry over to the new program. A setting that
+    * cannot be applied (e.g. no CAP_SYS_NICE) only produces a warning.
+    */
+    if (placement->pinned && sched_setaffinity(0, sizeof(cpu_set_t), &placement->cpus) == -1) {
+        fprintf(stderr, YELLOW "%s: " RESET, role);
+        perror(YELLOW "sched_setaffinity" RESET);
+    }
+    if (placement->niceSet && setpriority(PRIO_PROCESS, 0, placement->nice) == -1) {
+        fprintf(stderr, YELLOW "%s: " RESET, role);
+        perror(YELLOW "setpriority" RESET);
+    }
+    if (placement->fifoPriority > 0) {
+        struct sched_param param = {.sched_priority = placement->fifoPriority};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+            fprintf(stderr, YELLOW "%s: " RESET, role);
+            perror(YELLOW "sched_setscheduler" RESET);
+        }
+    }
+}
+
+
+int waitForRoles(const int roles[], int count) {
+/*
+  * Startup barrier: waits until the given roles have reported ready (reportReady()), taking one
+  * unit of SEM_READY per report of any role, for at most STARTUP_TIMEOUT_MS.
+  *
+  * @param roles ROLE_* to wait for.
+  * @return 1 if all of them are ready, 0 on timeout.
+*/
+
+    long long deadlineNs = sm->launchedAtNs + STARTUP_TIMEOUT_MS * 1000000LL;
+    while (1) {
+        int ready = 1;
+        for (int i = 0; i < count; i++) {
+            if (sm->readyAtNs[roles[i]] == 0) ready = 0;
+        }
+        if (ready) {
+            return 1;
+        }
+
+        long long leftNs = deadlineNs - getMonotonicTimeNs();
+        if (leftNs <= 0) {
+            return 0;
+        }
+        struct sembuf operation = {SEM_READY, -1, 0};
+        struct timespec timeout = {leftNs / 1000000000LL, leftNs % 1000000000LL};
+        if (semtimedop(semid, &operation, 1, &timeout) == -1 && errno != EINTR && errno != EAGAIN) {
+            perror(RED "semtimedop SEM_READY" RESET);
+            exit(EXIT_FAILURE);
+        }
     }
 }
 
 
-int main() {
+void printStartup(long long firstArrivalNs) {
+/*
+  * Cold start summary, everything after rejs launched the roles: when each role reported ready,
+  * when the first passenger arrived and when it first boarded.
+*/
+
+    const char *roleNames[] = STARTUP_ROLE_NAMES;
+    const LiveStats *live = attachSharedSection(SECTION_LIVE_STATS);
+
+    printf(GREEN "Startup:");
+    for (int role = 0; role < STARTUP_ROLES; role++) {
+        if (sm->readyAtNs[role] > 0) {
+            printf(" %s ready after %.3f ms,", roleNames[role], (sm->readyAtNs[role] - sm->launchedAtNs) / 1e6);
+        }
+    }
+    printf(" arrivals from %.3f ms, ", (firstArrivalNs - sm->launchedAtNs) / 1e6);
+    if (live->firstBoardingNs > 0) {
+        printf("first boarding after %.3f ms." RESET "\n", (live->firstBoardingNs - sm->launchedAtNs) / 1e6);
+    } else {
+        printf("nobody boarded." RESET "\n");
+    }
+}
+
+
+void writeRunReport(const char *path, long long startNs, double requestedRate, double achievedRate) {
+    /*
+    * Writes the finished day as key=value lines, read by rejs-sweep by key: wall seconds,
+    * ship captain CPU seconds, CPU seconds of all processes, voluntary and involuntary context
+    * switches, passengers boarded, voyages completed, ship captain run queue delay [ms] and
+    * timeslices, boarding latency p99 [us], mean dock turnaround [ms], requested and achieved
+    * arrival rate [passengers/s], wasted bridge round trips per voyage, bridge requests handled
+    * by the captain per second, their mean queueing delay [us], captain syscalls per request,
+    * passengers boarded per second of loading, and the ship captain's startup and time to
+    * first boarding [ms], both from launch (-1 = never). The first line is the format version.
+    */
+    FILE *report = fopen(path, "w");
+    if (report == NULL) {
+        perror(YELLOW "fopen run report" RESET);
+        return;
+    }
+
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    double captainCpu = captainUsage.ru_utime.tv_sec + captainUsage.ru_utime.tv_usec / 1e6
+                      + captainUsage.ru_stime.tv_sec + captainUsage.ru_stime.tv_usec / 1e6;
+    double totalCpu = self.ru_utime.tv_sec + self.ru_utime.tv_usec / 1e6 + self.ru_stime.tv_sec + self.ru_stime.tv_usec / 1e6
+                    + children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 + children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+
+    const LiveStats *live = attachSharedSection(SECTION_LIVE_STATS);
+    double wallSeconds = (getMonotonicTimeNs() - startNs) / 1e9;
+    fprintf(report, "version=%d\n", RUN_REPORT_VERSION);
+    fprintf(report, "wallS=%.3f\ncaptainCpuS=%.3f\ntotalCpuS=%.3f\n", wallSeconds, captainCpu, totalCpu);
+    fprintf(report, "voluntaryCs=%ld\ninvoluntaryCs=%ld\n", self.ru_nvcsw + children.ru_nvcsw, self.ru_nivcsw + children.ru_nivcsw);
+    fprintf(report, "boarded=%lld\nvoyages=%lld\n", live->boardedTotal, live->voyagesCompleted);
+    fprintf(report, "captainRunDelayMs=%.3f\ncaptainTimeslices=%lld\n", live->captainRunDelayNs / 1e6, live->captainTimeslices);
+    fprintf(report, "boardingP99Us=%lld\n", latencyPercentileUs(live->boardingLatencyBuckets, 99));
+    fprintf(report, "turnaroundMs=%.3f\n", live->turnarounds > 0 ? live->turnaroundsNs / 1e6 / live->turnarounds : 0);
+    fprintf(report, "requestedRate=%.3f\nachievedRate=%.3f\n", requestedRate, achievedRate);
+    fprintf(report, "wastedTripsPerVoyage=%.3f\n", live->voyagesCompleted > 0 ? (double)live->wastedBridgeTrips / live->voyagesCompleted : 0);
+    fprintf(report, "captainRequestsPerS=%.1f\n", live->requestsReceived / wallSeconds);
+    fprintf(report, "requestDelayUs=%.1f\n", live->requestsReceived > 0 ? live->requestDelayNs / 1e3 / live->requestsReceived : 0);
+    fprintf(report, "syscallsPerRequest=%.3f\n", live->requestsReceived > 0 ? (double)live->requestSyscalls / live->requestsReceived : 0);
+    fprintf(report, "loadingRate=%.3f\n", live->loadingWindowsNs > 0 ? live->boardedTotal / (live->loadingWindowsNs / 1e9) : 0);
+    fprintf(report, "captainReadyMs=%.3f\n", sm->readyAtNs[ROLE_SHIP_CAPTAIN] > 0 ? (sm->readyAtNs[ROLE_SHIP_CAPTAIN] - sm->launchedAtNs) / 1e6 : -1);
+    fprintf(report, "firstBoardingMs=%.3f\n", live->firstBoardingNs > 0 ? (live->firstBoardingNs - sm->launchedAtNs) / 1e6 : -1);
+    fclose(report);
+}
+
+
+int main(int argc, char *argv[]) {
+    /*
+    * Command line options:
+    * -p <count>   number of passengers to generate
+    * -r <rate>    passengers spawned per second, 0 = as fast as possible (short for -A constant:<rate>)
+    * -A <model>   arrival model: burst, constant:<rate>, poisson:<rate>, onoff:<rate>:<onMs>:<offMs>
+    *              or replay:<path>, see arrival.c
+    * -S <seed>    seed of the random arrival models, printed if not given
+    * -o <path>    write a run report there when the day ends
+    * -C <cpus>    pin the ship captain to these CPUs, e.g. "1" or "0,2-3"
+    * -N <nice>    nice value of the ship captain, negative = higher priority
+    * -F <prio>    run the ship captain under SCHED_FIFO with this priority
+    * -H <cpus>    pin the harbour captain to these CPUs
+    * -P <cpus>    confine passengers to these CPUs
+    * -D <policy>  departure policy of the ship captain: fixed, full, load[:factor] or rate
+    * -L           two-lane bridge: disembarking gets its own lane and overlaps boarding
+    * -Q <queue>   how bridge requests reach the ship captain: ring (shared-memory ring, default) or sysv
+    * -E           passenger engine: all passengers are records driven by one passengerEngine process
+    * -G <g>[:order] gangways towards the ship, 1..MAX_GANGWAYS of BRIDGE_CAPACITY each; order global
+    *              (default, one boarding order over all gangways) or gangway (each gangway its own order)
+    */
+    int numPassengers = NUM_PASSENGERS, twoLaneBridge = 0, requestTransport = REQUEST_TRANSPORT, passengerEngine = 0, opt;
+    int gangways = 1, gangwayOrder = GANGWAY_ORDER_GLOBAL;
+    const char *reportPath = NULL, *departure = DEPARTURE_POLICY, *arrivals = "burst";
+    char constantArrivals[32];
+    unsigned int arrivalSeed = time(NULL) ^ getpid();
+    Placement captainPlacement = {0}, harbourPlacement = {0}, passengerPlacement = {0};
+    while ((opt = getopt(argc, argv, "p:r:A:S:o:C:N:F:H:P:D:LQ:EG:")) != -1) {
+        if (opt == 'p') {
+            numPassengers = atoi(optarg);
+        } else if (opt == 'r') {
+            snprintf(constantArrivals, sizeof(constantArrivals), "constant:%s", optarg);
+            arrivals = atoi(optarg) > 0 ? constantArrivals : "burst";
+        } else if (opt == 'A') {
+            arrivals = optarg;
+        } else if (opt == 'S') {
+            arrivalSeed = strtoul(optarg, NULL, 10);
+        } else if (opt == 'o') {
+            reportPath = optarg;
+        } else if (opt == 'C') {
+            parseCpuList(optarg, &captainPlacement.cpus);
+            captainPlacement.pinned = 1;
+        } else if (opt == 'N') {
+            captainPlacement.nice = atoi(optarg);
+            captainPlacement.niceSet = 1;
+        } else if (opt == 'F') {
+            captainPlacement.fifoPriority = atoi(optarg);
+        } else if (opt == 'H') {
+            parseCpuList(optarg, &harbourPlacement.cpus);
+            harbourPlacement.pinned = 1;
+        } else if (opt == 'P') {
+            parseCpuList(optarg, &passengerPlacement.cpus);
+            passengerPlacement.pinned = 1;
+        } else if (opt == 'D') {
+            departure = optarg;
+            if (selectDeparturePolicy(departure) == NULL) {
+                fprintf(stderr, RED "Unknown departure policy \"%s\", use fixed, full, load[:factor] or rate." RESET "\n", departure);
+                exit(EXIT_FAILURE);
+            }
+        } else if (opt == 'L') {
+            twoLaneBridge = 1;
+        } else if (opt == 'Q' && (strcmp(optarg, "ring") == 0 || strcmp(optarg, "sysv") == 0)) {
+            requestTransport = strcmp(optarg, "ring") == 0 ? REQUEST_TRANSPORT_RING : REQUEST_TRANSPORT_SYSV;
+        } else if (opt == 'E') {
+            passengerEngine = 1;
+        } else if (opt == 'G') {
+            char *order;
+            gangways = strtol(optarg, &order, 10);
+            if (gangways < 1 || gangways > MAX_GANGWAYS || (*order != '\0' && strcmp(order, ":global") != 0 && strcmp(order, ":gangway") != 0)) {
+                fprintf(stderr, RED "Bad gangways \"%s\", use 1..%d with an optional :global or :gangway order." RESET "\n", optarg, MAX_GANGWAYS);
+                exit(EXIT_FAILURE);
+            }
+            gangwayOrder = strcmp(order, ":gangway") == 0 ? GANGWAY_ORDER_GANGWAY : GANGWAY_ORDER_GLOBAL;
+        } else {
+            fprintf(stderr, RED "Usage: %s [-p passengers] [-r passengersPerSecond] [-A arrivalModel] [-S seed] [-o reportPath] [-C cpus] [-N nice] [-F fifoPriority] [-H cpus] [-P cpus] [-D departurePolicy] [-L] [-Q ring|sysv] [-E] [-G gangways[:global|gangway]]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    long long startNs = getMonotonicTimeNs();
+
+    ArrivalModel *arrivalModel = createArrivalModel(arrivals, arrivalSeed);
+    if (arrivalModel == NULL) {
+        fprintf(stderr, RED "Invalid arrival model \"%s\", see arrival.c." RESET "\n", arrivals);
+        exit(EXIT_FAILURE);
+    }
+    printf(GREEN "Arrival model %s, seed %u." RESET "\n", arrivals, arrivalSeed);
+
     /*
     * Setup signal handling for SIGINT and SIGCHLD.
     *
@@ -58,60 +334,117 @@ int main() {
 
     handleInput();
 
+    // Per-process trace files are collected in TRACE_DIR and merged at the end
+    if (getenv(TRACE_ENV) != NULL && mkdir(TRACE_DIR, 0700) == -1 && errno != EEXIST) {
+        perror(YELLOW "mkdir trace dir" RESET);
+    }
+
     /*
     * Initialize shared memory and semaphores.
     * Create message queue and FIFOs for communication.
     */
-    shmid = initializeSharedMemory();
-    sm = attachSharedMemory(shmid);
+    regionFd = initializeSharedMemory();
+    sm = attachSharedMemory(regionFd);
+    initializeRequestRing(attachSharedSection(SECTION_REQUEST_RING));
+    initializeRequestRing(attachSharedSection(SECTION_REPLY_RING));
+    initializeRegistry(attachSharedSection(SECTION_REGISTRY));
     semid = initializeSemaphores();
+    publishRegionInfo(regionFd);
     msq_id = msgget(BRIDGE_QUEUE_KEY, IPC_CREAT | MSG_PERMISSIONS);
 
-    // Create FIFO for communication from ship captain
-    if (mkfifo(FIFO_PATH, 0600) == -1  && errno != EEXIST) {
-        perror(RED "mkfifo fifo_path" RESET);
-        exit(EXIT_FAILURE);
-    }
-
     // FIFO for passengers
     if (mkfifo(FIFO_PATH_PASSENGERS, 0600) == -1 && errno != EEXIST) {
         perror(RED "mkfifo fifo_path_passengers" RESET);
         exit(EXIT_FAILURE);
     }
 
-    char shmStr[16], semStr[16];
-    sprintf(shmStr, "%d", shmid);
+    char regionStr[16], semStr[16];
+    sprintf(regionStr, "%d", regionFd);
     sprintf(semStr, "%d", semid);
 
+    /*
+    * A checkpoint left by an interrupted run lets the day continue
+    * after its last completed voyage instead of starting from zero.
+    */
+    long long recoveryStart = getMonotonicTimeNs();
+    Checkpoint *ckpt = openCheckpoint(CHECKPOINT_PATH);
+    CheckpointState restored;
+    int warmStart = loadCheckpoint(ckpt, &restored) && restored.shared.currentVoyage < NUMBER_OF_TRIPS_PER_DAY;
+    closeCheckpoint(ckpt);
+
     // Shared memory initialization
     waitSemaphore(semid, SEM_MUTEX);
     sm->peopleOnShip = 0;
     sm->peopleOnBridge = 0;
-    sm->currentVoyage = 0;
+    sm->currentVoyage = warmStart ? restored.shared.currentVoyage : 0;
     sm->signalEndOfDay = 0;
     sm->queueDirection = 0;
     sm->shipSailing = 0;
+    sm->twoLaneBridge = twoLaneBridge;
+    sm->peopleOnBridgeInbound = 0;
+    sm->peopleToDisembark = 0;
+    sm->requestTransport = requestTransport;
+    sm->passengerEngine = passengerEngine;
+    sm->passengersArrived = 0;
+    sm->gangways = gangways;
+    sm->gangwayOrder = gangwayOrder;
+    memset(sm->peopleOnGangway, 0, sizeof(sm->peopleOnGangway));
+    memset((void *)sm->readyAtNs, 0, sizeof(sm->readyAtNs));
+    sm->launchedAtNs = getMonotonicTimeNs();
     signalSemaphore(semid, SEM_MUTEX);
 
+    if (warmStart) {
+        printf(GREEN "Warm restart: continuing after voyage %d, state recovered in %.3f ms." RESET "\n", restored.shared.currentVoyage, (getMonotonicTimeNs() - recoveryStart) / 1e6);
+    }
+
     // Fork and execute shipCaptain
-    pid_t shipCaptainPid = fork();
+    shipCaptainPid = fork();
     if (shipCaptainPid == -1) {
         perror(RED "Error forking for shipCaptain" RESET);
         exit(EXIT_FAILURE);
     } else if (shipCaptainPid == 0) {
-        if (execl("./shipCaptain", "shipCaptain", shmStr, semStr, NULL) == -1) {
+        applyPlacement(&captainPlacement, "shipCaptain");
+        if (execl("./shipCaptain", "shipCaptain", regionStr, semStr, departure, NULL) == -1) {
             perror(RED "execl shipCaptain" RESET);
             exit(EXIT_FAILURE);
         }
     }
 
-    // Fork and execute harbourCaptain
+    // Fork and execute the passenger engine, it drives the passengers that arrive below
+    if (passengerEngine) {
+        char countStr[16];
+        sprintf(countStr, "%d", numPassengers);
+
+        pid_t enginePid = fork();
+        if (enginePid == -1) {
+            perror(RED "Error forking for passengerEngine" RESET);
+            exit(EXIT_FAILURE);
+        } else if (enginePid == 0) {
+            applyPlacement(&passengerPlacement, "passengerEngine");
+            if (execl("./passengerEngine", "passengerEngine", regionStr, semStr, countStr, NULL) == -1) {
+                perror(RED "execl passengerEngine" RESET);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    /*
+    * Startup barrier: passengers arrive only once the ship captain answers requests
+    * (and the passenger engine runs), so nobody sends into a queue nobody reads yet.
+    */
+    int arrivalRoles[] = {ROLE_SHIP_CAPTAIN, ROLE_PASSENGER_ENGINE};
+    if (!waitForRoles(arrivalRoles, passengerEngine ? 2 : 1)) {
+        fprintf(stderr, YELLOW "Roles not ready within %d ms, passengers arrive anyway." RESET "\n", STARTUP_TIMEOUT_MS);
+    }
+
+    // Fork and execute harbourCaptain, the control socket is open by now so it connects at once
     pid_t harbourCaptainPid = fork();
     if (harbourCaptainPid == -1) {
         perror(RED "Error forking for harbourCaptain" RESET);
         exit(EXIT_FAILURE);
     } else if (harbourCaptainPid == 0) {
-        if (execl("./harbourCaptain", "harbourCaptain", NULL) == -1) {
+        applyPlacement(&harbourPlacement, "harbourCaptain");
+        if (execl("./harbourCaptain", "harbourCaptain", regionStr, semStr, NULL) == -1) {
             perror(RED "execl harbourCaptain" RESET);
             exit(EXIT_FAILURE);
         }
@@ -127,10 +460,23 @@ int main() {
     srand(time(NULL));
 
     /*
-    * Generate passenger processes until the specified number of passengers is reached.
+    * Generate passenger processes (or let passenger engine records arrive) until the specified number of passengers is reached.
     * Stop if a 'stop' message is received from the FIFO.
+    * Arrivals follow the arrival model on an absolute monotonic schedule.
     */
-    for (int i = 1; i && i < NUM_PASSENGERS; i++) {
+    long long firstArrivalNs = getMonotonicTimeNs(), scheduledNs = firstArrivalNs, lastArrivalNs = firstArrivalNs, latenessNs = 0;
+    int spawned = 0;
+    for (int i = 1; i && i < numPassengers; i++) {
+        long long gapNs = nextArrivalGapNs(arrivalModel);
+        if (gapNs < 0) {
+            break; // Replay trace exhausted
+        }
+        scheduledNs += gapNs;
+        if (gapNs > 0) {
+            sleepUntilNs(scheduledNs);
+        }
+
+
         char buffer[10]; // Buffer for message
         ssize_t bytesRead = read(fifo_fd, buffer, sizeof(buffer));
 
@@ -142,25 +488,65 @@ int main() {
             }
         }
 
+        if (passengerEngine) {
+            // One more record of the engine comes to life
+            waitSemaphore(semid, SEM_MUTEX);
+            sm->passengersArrived++;
+            signalSemaphore(semid, SEM_MUTEX);
+
+            lastArrivalNs = getMonotonicTimeNs();
+            latenessNs += lastArrivalNs > scheduledNs ? lastArrivalNs - scheduledNs : 0;
+            spawned++;
+            continue;
+        }
+
         pid_t pid = fork();
-        if (pid == -1) {
+        if (pid == -1 && errno == EAGAIN) {
+            fprintf(stderr, YELLOW "Process limit reached after %d passengers. Stopping passenger creation." RESET "\n", i - 1);
+            break;
+        } else if (pid == -1) {
             perror(RED "Error forking passenger" RESET);
             exit(EXIT_FAILURE);
         } else if (pid == 0) {
-            if (execl("./passenger", "passenger", shmStr, semStr, NULL) == -1) {
+            applyPlacement(&passengerPlacement, "passenger");
+            if (execl("./passenger", "passenger", regionStr, semStr, NULL) == -1) {
                 perror(RED "execl passenger" RESET);
                 exit(EXIT_FAILURE);
             }
         }
 
-        // usleep(((rand() % 10) + 100) * 1000); // some random time between passengers generation
+        lastArrivalNs = getMonotonicTimeNs();
+        latenessNs += lastArrivalNs > scheduledNs ? lastArrivalNs - scheduledNs : 0;
+        spawned++;
+    }
+
+    double achievedRate = spawned > 1 && lastArrivalNs > firstArrivalNs ? (spawned - 1) / ((lastArrivalNs - firstArrivalNs) / 1e9) : 0;
+    if (arrivalModel->requestedRate > 0) {
+        printf(GREEN "Arrivals (%s): %d passengers, requested %.2f/s, achieved %.2f/s, mean lateness %.1f us." RESET "\n", arrivalModel->name,
+               spawned, arrivalModel->requestedRate, achievedRate, spawned > 0 ? latenessNs / 1e3 / spawned : 0);
+    } else {
+        printf(GREEN "Arrivals (%s): %d passengers at %.2f/s." RESET "\n", arrivalModel->name, spawned, achievedRate);
+    }
+
+    struct rusage usage;
+    pid_t pid;
+    while ((pid = wait4(-1, NULL, 0, &usage)) > 0) {
+        if (pid == shipCaptainPid) captainUsage = usage;
     }
+    printStartup(firstArrivalNs);
 
-    while (wait(NULL) > 0) {}
+    if (reportPath != NULL) {
+        writeRunReport(reportPath, startNs, arrivalModel->requestedRate, achievedRate);
+    }
+
+    int tracedProcesses = traceMerge();
+    if (tracedProcesses >= 0) {
+        printf(GREEN "Trace of %d processes written to %s." RESET "\n", tracedProcesses, getenv(TRACE_ENV));
+    }
 
     // Cleanup
-    shmdt(sm);
-    cleanupSharedMemory(shmid);
+    detachSharedMemory();
+    cleanupSharedMemory(regionFd);
     cleanupSemaphores(semid);
 
     if (msgctl(msq_id, IPC_RMID, NULL) == -1) {
@@ -168,8 +554,9 @@ int main() {
     }
 
     close(fifo_fd);
-    unlink(FIFO_PATH); // Delete FIFO file
+    unlink(CONTROL_SOCKET_PATH);
     unlink(FIFO_PATH_PASSENGERS);
+    unlink(REGION_INFO_PATH);
     printf(GREEN "Main process finished. Cleaned up shared memory and semaphores." RESET "\n");
     return 0;
 }
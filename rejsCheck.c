@@ -0,0 +1,161 @@
+#include "utils.h"
+#include "shared_region.h"
+
+/*
+ * rejs-check: samples the shared state of a running simulation and checks the safety rules:
+ *   - 0 <= peopleOnShip <= SHIP_CAPACITY
+ *   - 0 <= peopleOnBridge <= gangways * BRIDGE_CAPACITY
+ *   - 0 <= peopleOnGangway[g] <= BRIDGE_CAPACITY, passengers on each gangway adding up to at most
+ *     peopleOnBridge; on a single-lane bridge those walking ashore share the first gangway
+ *   - 0 <= peopleOnBridgeInbound <= BRIDGE_INBOUND_CAPACITY (two-lane bridge)
+ *   - the bridge (both lanes) is empty while the ship is on a voyage
+ *   - nobody boards while the bridge is turned towards land (queueDirection == 1)
+ *   - no passenger arrives before the ship captain has reported ready (startup barrier)
+ * Every sample is taken under SEM_MUTEX, the lock all writers of SharedMemory hold,
+ * so it is a consistent snapshot. Violations are reported with a timestamped state dump
+ * on stderr and in VIOLATIONS_LOG_PATH.
+ *
+ * Usage: rejs-check [-i intervalUs]
+ * Exits with 1 if any violation was found.
+*/
+
+typedef struct {
+    SharedMemory shared;
+    int phase;
+    long long timestampNs;
+} Sample;
+
+static long long violations = 0;
+static FILE *violationsLog;
+
+
+int lockForSample(int semid, int op) {
+/*
+  * Takes or releases SEM_MUTEX without exiting when the simulation removes the semaphores.
+  *
+  * @return 0 on success, -1 once the semaphore set is gone.
+*/
+
+    struct sembuf operation = {SEM_MUTEX, op, SEM_UNDO}; // A killed rejs-check must not leave SEM_MUTEX held
+    while (semop(semid, &operation, 1) == -1) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+
+void reportViolation(const char *rule, const Sample *previous, const Sample *sample) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct tm local;
+    localtime_r(&now.tv_sec, &local);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    const SharedMemory *sm = &sample->shared;
+    FILE *outputs[] = {stderr, violationsLog};
+    for (int i = 0; i < 2; i++) {
+        if (outputs[i] == NULL) continue;
+        fprintf(outputs[i], "[%s.%06ld] VIOLATION: %s\n", stamp, now.tv_nsec / 1000, rule);
+        fprintf(outputs[i], "    state: ship=%d bridge=%d inbound=%d voyage=%d endOfDay=%d queueDirection=%d shipSailing=%d phase=%d\n",
+                sm->peopleOnShip, sm->peopleOnBridge, sm->peopleOnBridgeInbound, sm->currentVoyage, sm->signalEndOfDay, sm->queueDirection, sm->shipSailing, sample->phase);
+        if (previous != NULL) {
+            fprintf(outputs[i], "    previous sample %.3f ms earlier: ship=%d bridge=%d voyage=%d queueDirection=%d shipSailing=%d phase=%d\n",
+                    (sample->timestampNs - previous->timestampNs) / 1e6, previous->shared.peopleOnShip, previous->shared.peopleOnBridge,
+                    previous->shared.currentVoyage, previous->shared.queueDirection, previous->shared.shipSailing, previous->phase);
+        }
+        fflush(outputs[i]);
+    }
+    violations++;
+}
+
+
+void checkSample(const Sample *previous, const Sample *sample) {
+    const SharedMemory *sm = &sample->shared;
+
+    if (sm->peopleOnShip < 0 || sm->peopleOnShip > SHIP_CAPACITY) {
+        reportViolation("peopleOnShip outside 0..SHIP_CAPACITY", previous, sample);
+    }
+    if (sm->peopleOnBridge < 0 || sm->peopleOnBridge > sm->gangways * BRIDGE_CAPACITY) {
+        reportViolation("peopleOnBridge outside 0..gangways * BRIDGE_CAPACITY", previous, sample);
+    }
+    int onGangways = 0;
+    for (int g = 0; g < MAX_GANGWAYS; g++) {
+        int limit = g < sm->gangways ? BRIDGE_CAPACITY : 0;
+        if (sm->peopleOnGangway[g] < 0 || sm->peopleOnGangway[g] > limit) {
+            reportViolation("peopleOnGangway outside 0..BRIDGE_CAPACITY", previous, sample);
+        }
+        onGangways += sm->peopleOnGangway[g];
+    }
+    if (onGangways > sm->peopleOnBridge || sm->peopleOnBridge - onGangways + sm->peopleOnGangway[0] > BRIDGE_CAPACITY) {
+        reportViolation("gangway counts do not match peopleOnBridge", previous, sample);
+    }
+    if (sm->peopleOnBridgeInbound < 0 || sm->peopleOnBridgeInbound > BRIDGE_INBOUND_CAPACITY) {
+        reportViolation("peopleOnBridgeInbound outside 0..BRIDGE_INBOUND_CAPACITY", previous, sample);
+    }
+    if (sample->phase == PHASE_VOYAGE && sm->shipSailing == 1 && (sm->peopleOnBridge != 0 || sm->peopleOnBridgeInbound != 0)) {
+        reportViolation("bridge not empty during the voyage", previous, sample);
+    }
+    if (previous != NULL && previous->shared.queueDirection == 1 && sm->queueDirection == 1 &&
+        previous->shared.currentVoyage == sm->currentVoyage && sm->peopleOnShip > previous->shared.peopleOnShip) {
+        reportViolation("boarding while the bridge is turned towards land", previous, sample);
+    }
+    if (sm->readyAtNs[ROLE_SHIP_CAPTAIN] == 0 && (sm->passengersArrived > 0 || sm->peopleOnBridge > 0 || sm->peopleOnShip > 0)) {
+        reportViolation("passengers arrived before the ship captain was ready", previous, sample);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int intervalUs = 200, opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        if (opt == 'i') {
+            intervalUs = atoi(optarg);
+        } else {
+            fprintf(stderr, RED "Usage: %s [-i intervalUs]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const RegionHeader *region = attachPublishedRegionReadOnly();
+    const SharedMemory *sm = findRegionSection(region, SECTION_SHARED_MEMORY);
+    const LiveStats *live = findRegionSection(region, SECTION_LIVE_STATS);
+    if (sm == NULL || live == NULL) {
+        fprintf(stderr, RED "Shared region is missing sections." RESET "\n");
+        exit(EXIT_FAILURE);
+    }
+
+    key_t semKey = ftok(".", SEM_PROJECT_ID);
+    int semid = semget(semKey, 0, 0);
+    if (semid == -1) {
+        perror(RED "semget rejs-check" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    violationsLog = fopen(VIOLATIONS_LOG_PATH, "a");
+    struct timespec interval = {intervalUs / 1000000, (intervalUs % 1000000) * 1000L};
+    Sample samples[2];
+    long long sampleCount = 0, startNs = getMonotonicTimeNs();
+
+    while (1) {
+        Sample *sample = &samples[sampleCount % 2];
+        Sample *previous = sampleCount > 0 ? &samples[(sampleCount + 1) % 2] : NULL;
+
+        if (lockForSample(semid, -1) == -1) break;
+        sample->shared = *sm;
+        sample->phase = live->phase;
+        sample->timestampNs = getMonotonicTimeNs();
+        if (lockForSample(semid, 1) == -1) break;
+
+        checkSample(previous, sample);
+        sampleCount++;
+
+        if (sample->phase == PHASE_FINISHED) break;
+        if (intervalUs > 0) nanosleep(&interval, NULL);
+    }
+
+    double seconds = (getMonotonicTimeNs() - startNs) / 1e9;
+    printf("rejs-check: %lld samples in %.1f s (%.0f/s), %lld violations.\n", sampleCount, seconds, seconds > 0 ? sampleCount / seconds : 0.0, violations);
+    if (violationsLog != NULL) fclose(violationsLog);
+    return violations > 0 ? 1 : 0;
+}
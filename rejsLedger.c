@@ -0,0 +1,210 @@
+#include "utils.h"
+#include "ledger.h"
+
+/*
+ * rejs-ledger: summarizes the voyage ledger the ship captain appends to (LEDGER_PATH) over
+ * every run it holds: departure reasons, percentiles of each voyage measure, one row per run
+ * and the trend across runs. The records are binary, so a long soak costs no parsing.
+ *
+ * Usage: rejs-ledger [-f ledgerPath] [-n runsShown]
+*/
+
+#define MEASURES 8
+
+static const char *reasonNames[] = DEPARTURE_REASON_NAMES;
+static const char *measureNames[MEASURES] = {
+    "loading window [ms]", "bridge clearing [ms]", "disembark [ms]", "voyage cycle [s]",
+    "load factor [%]", "denials", "peak bridge", "wasted trips"
+};
+
+// One run: the records with the same dayStartNs, appended one after the other
+typedef struct {
+    size_t first, count;
+} Run;
+
+
+double measure(const VoyageRecord *record, int which) {
+/*
+  * @param which Index into measureNames.
+  * @return The measure of one voyage, negative if the voyage has none.
+*/
+
+    switch (which) {
+        case 0: return record->loadingNs / 1e6;
+        case 1: return record->preparationNs / 1e6;
+        case 2: return record->disembarkNs > 0 ? record->disembarkNs / 1e6 : -1;
+        case 3: return (record->endNs - record->startNs) / 1e9;
+        case 4: return record->shipCapacity > 0 ? 100.0 * record->passengers / record->shipCapacity : -1;
+        case 5: return record->denials;
+        case 6: return record->peakBridge;
+        default: return record->wastedTrips;
+    }
+}
+
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+
+double percentile(const double sorted[], size_t count, double p) {
+    // Nearest-rank percentile of a sorted array
+    size_t rank = (size_t)(p / 100.0 * count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+
+double slope(const double y[], int count) {
+/*
+  * Least-squares slope of y over its index.
+*/
+
+    if (count < 2) return 0;
+    double meanX = (count - 1) / 2.0, meanY = 0, covariance = 0, variance = 0;
+    for (int i = 0; i < count; i++) meanY += y[i];
+    meanY /= count;
+    for (int i = 0; i < count; i++) {
+        covariance += (i - meanX) * (y[i] - meanY);
+        variance += (i - meanX) * (i - meanX);
+    }
+    return covariance / variance;
+}
+
+
+double runMean(const VoyageRecord *records, const Run *run, int which) {
+    double sum = 0;
+    int used = 0;
+    for (size_t i = run->first; i < run->first + run->count; i++) {
+        double value = measure(&records[i], which);
+        if (value >= 0) {
+            sum += value;
+            used++;
+        }
+    }
+    return used > 0 ? sum / used : 0;
+}
+
+
+void formatTime(long long realNs, char *text, size_t size) {
+    time_t seconds = realNs / 1000000000LL;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    strftime(text, size, "%Y-%m-%d %H:%M:%S", &local);
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *path = LEDGER_PATH;
+    int runsShown = 20, opt;
+
+    while ((opt = getopt(argc, argv, "f:n:")) != -1) {
+        if (opt == 'f') path = optarg;
+        else if (opt == 'n') runsShown = atoi(optarg);
+        else {
+            fprintf(stderr, RED "Usage: %s [-f ledgerPath] [-n runsShown]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    size_t count, skipped;
+    VoyageRecord *records = readLedger(path, &count, &skipped);
+    if (records == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Only complete records count, a crash while appending leaves a torn one behind
+    if (skipped > 0) {
+        fprintf(stderr, YELLOW "%s: skipped %zu damaged stretches." RESET "\n", path, skipped);
+    }
+    if (count == 0) {
+        printf(CYAN "=== Ledger ===" RESET " %s holds no voyages yet.\n", path);
+        return 0;
+    }
+
+    Run *runs = malloc(count * sizeof(Run));
+    double *values = malloc(count * sizeof(double));
+    if (runs == NULL || values == NULL) {
+        perror(RED "malloc ledger" RESET);
+        exit(EXIT_FAILURE);
+    }
+    int runCount = 0;
+    int reasons[DEPARTURE_REASONS] = {0};
+    for (size_t i = 0; i < count; i++) {
+        if (runCount == 0 || records[i].dayStartNs != records[runs[runCount - 1].first].dayStartNs) {
+            runs[runCount].first = i;
+            runs[runCount].count = 0;
+            runCount++;
+        }
+        runs[runCount - 1].count++;
+        if (records[i].departureReason >= 0 && records[i].departureReason < DEPARTURE_REASONS) {
+            reasons[records[i].departureReason]++;
+        }
+    }
+
+    char from[32], to[32];
+    formatTime(records[0].startNs, from, sizeof(from));
+    formatTime(records[count - 1].endNs, to, sizeof(to));
+    printf(CYAN "=== Ledger ===" RESET " %s: %zu voyages in %d runs, %s .. %s\n", path, count, runCount, from, to);
+    printf("departures   ");
+    for (int r = 0; r < DEPARTURE_REASONS; r++) {
+        printf(" %s %d (%.1f%%)%s", reasonNames[r], reasons[r], 100.0 * reasons[r] / count, r + 1 < DEPARTURE_REASONS ? "," : "\n");
+    }
+
+    // Percentiles over every voyage
+    printf("\n%-22s %10s %10s %10s %10s %10s %8s\n", "per voyage", "p50", "p90", "p99", "max", "mean", "voyages");
+    for (int m = 0; m < MEASURES; m++) {
+        size_t used = 0;
+        double sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            double value = measure(&records[i], m);
+            if (value >= 0) {
+                values[used++] = value;
+                sum += value;
+            }
+        }
+        if (used == 0) {
+            printf("%-22s %10s\n", measureNames[m], "-");
+            continue;
+        }
+        qsort(values, used, sizeof(double), compareDoubles);
+        printf("%-22s %10.1f %10.1f %10.1f %10.1f %10.1f %8zu\n", measureNames[m], percentile(values, used, 50), percentile(values, used, 90),
+               percentile(values, used, 99), values[used - 1], sum / used, used);
+    }
+
+    // The latest runs, one row each
+    int firstShown = runCount > runsShown ? runCount - runsShown : 0;
+    printf("\n%-19s  %-8s %7s %9s %11s %13s %8s %6s\n", "run started", "policy", "voyages", "load [%]", "loading [ms]", "disembark [ms]", "denials", "peak");
+    for (int r = firstShown; r < runCount; r++) {
+        const Run *run = &runs[r];
+        char started[32];
+        int denials = 0, peak = 0;
+        for (size_t i = run->first; i < run->first + run->count; i++) {
+            denials += records[i].denials;
+            if (records[i].peakBridge > peak) peak = records[i].peakBridge;
+        }
+        formatTime(records[run->first].dayStartNs, started, sizeof(started));
+        printf("%-19s  %-8.8s %7zu %9.1f %11.1f %13.1f %8d %6d\n", started, records[run->first].departurePolicy, run->count,
+               runMean(records, run, 4), runMean(records, run, 0), runMean(records, run, 2), denials, peak);
+    }
+    if (firstShown > 0) {
+        printf("(%d earlier runs not shown)\n", firstShown);
+    }
+
+    // Trend of the per-run means across runs
+    if (runCount >= 2) {
+        printf("\ntrend over %d runs, per run:", runCount);
+        int trended[] = {4, 0, 2, 5};
+        for (int t = 0; t < 4; t++) {
+            for (int r = 0; r < runCount; r++) values[r] = runMean(records, &runs[r], trended[t]);
+            printf(" %s %+.2f%s", measureNames[trended[t]], slope(values, runCount), t < 3 ? "," : "\n");
+        }
+    }
+
+    free(runs);
+    free(values);
+    free(records);
+    return 0;
+}
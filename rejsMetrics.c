@@ -0,0 +1,215 @@
+#include "utils.h"
+#include "shared_region.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/*
+ * rejs-metrics: sidecar serving the simulation's counters in Prometheus text format
+ * over a local Unix socket (scrape with: curl --unix-socket /tmp/rejs-metrics.sock http://localhost/metrics).
+ * It maps the shared region read-only and never takes SEM_MUTEX, so scrapes cannot
+ * stall the boarding loop in performCruiseOperations().
+ *
+ * Usage: rejs-metrics [-s socketPath]              serve scrapes until SIGINT/SIGTERM
+ *        rejs-metrics [-s socketPath] -b scrapes    scrape a running sidecar and report the cost
+*/
+
+#define METRICS_BUFFER_SIZE 4096
+
+static volatile sig_atomic_t stopRequested = 0;
+
+
+void handleStop(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+
+int renderMetrics(const SharedMemory *sm, const LiveStats *live, char *buffer, size_t size) {
+/*
+ * Renders all metrics in Prometheus text exposition format.
+ *
+ * @return Number of bytes written to the buffer.
+*/
+
+    return snprintf(buffer, size,
+        "# HELP rejs_people_on_ship Passengers currently on the ship.\n"
+        "# TYPE rejs_people_on_ship gauge\n"
+        "rejs_people_on_ship %d\n"
+        "# HELP rejs_people_on_bridge Passengers currently on the bridge.\n"
+        "# TYPE rejs_people_on_bridge gauge\n"
+        "rejs_people_on_bridge %d\n"
+        "# HELP rejs_current_voyage Number of voyages completed today, as kept in shared memory.\n"
+        "# TYPE rejs_current_voyage gauge\n"
+        "rejs_current_voyage %d\n"
+        "# HELP rejs_queue_depth Sequences assigned but not yet boarded or denied.\n"
+        "# TYPE rejs_queue_depth gauge\n"
+        "rejs_queue_depth %d\n"
+        "# HELP rejs_boarded_total Passengers boarded.\n"
+        "# TYPE rejs_boarded_total counter\n"
+        "rejs_boarded_total %lld\n"
+        "# HELP rejs_denied_total Boarding requests denied.\n"
+        "# TYPE rejs_denied_total counter\n"
+        "rejs_denied_total %lld\n"
+        "# HELP rejs_voyages_completed_total Voyages completed.\n"
+        "# TYPE rejs_voyages_completed_total counter\n"
+        "rejs_voyages_completed_total %lld\n"
+        "# HELP rejs_loading_window_seconds Duration of loading windows.\n"
+        "# TYPE rejs_loading_window_seconds summary\n"
+        "rejs_loading_window_seconds_sum %.6f\n"
+        "rejs_loading_window_seconds_count %lld\n"
+        "# HELP rejs_last_loading_window_seconds Duration of the most recent loading window.\n"
+        "# TYPE rejs_last_loading_window_seconds gauge\n"
+        "rejs_last_loading_window_seconds %.6f\n"
+        "# HELP rejs_early_departures_total Early departure signals (SIGUSR1) received.\n"
+        "# TYPE rejs_early_departures_total counter\n"
+        "rejs_early_departures_total %lld\n"
+        "# HELP rejs_end_of_day_events_total End-of-day signals (SIGUSR2) received.\n"
+        "# TYPE rejs_end_of_day_events_total counter\n"
+        "rejs_end_of_day_events_total %lld\n"
+        "# HELP rejs_captain_loops_total Iterations of the captain's bridge queue loop.\n"
+        "# TYPE rejs_captain_loops_total counter\n"
+        "rejs_captain_loops_total %lld\n",
+        sm->peopleOnShip, sm->peopleOnBridge, sm->currentVoyage, live->queueDepth,
+        live->boardedTotal, live->deniedTotal, live->voyagesCompleted,
+        live->loadingWindowsNs / 1e9, live->loadingWindows, live->lastLoadingWindowNs / 1e9,
+        live->earlyDepartures, live->endOfDayEvents, live->captainLoops);
+}
+
+
+void serveMetrics(const char *socketPath) {
+/*
+ * Accepts scrapes one at a time: reads the request, answers with a minimal HTTP/1.0
+ * response carrying the metrics and closes the connection.
+*/
+
+    const RegionHeader *region = attachPublishedRegionReadOnly();
+    const SharedMemory *sm = findRegionSection(region, SECTION_SHARED_MEMORY);
+    const LiveStats *live = findRegionSection(region, SECTION_LIVE_STATS);
+    if (sm == NULL || live == NULL) {
+        fprintf(stderr, RED "Shared region is missing sections." RESET "\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server == -1) {
+        perror(RED "socket" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+    unlink(socketPath);
+
+    if (bind(server, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(server, 16) == -1) {
+        perror(RED "bind/listen metrics socket" RESET);
+        exit(EXIT_FAILURE);
+    }
+    printf(GREEN "Serving metrics on %s" RESET "\n", socketPath);
+
+    char request[1024], body[METRICS_BUFFER_SIZE], header[128];
+    long long scrapes = 0, renderNs = 0;
+
+    while (!stopRequested) {
+        int client = accept(server, NULL, NULL);
+        if (client == -1) {
+            if (errno == EINTR) continue;
+            perror(RED "accept" RESET);
+            break;
+        }
+
+        // The request itself does not matter, every path gets the metrics
+        if (read(client, request, sizeof(request)) < 0) {
+            close(client);
+            continue;
+        }
+
+        long long start = getMonotonicTimeNs();
+        int bodyLength = renderMetrics(sm, live, body, sizeof(body));
+        renderNs += getMonotonicTimeNs() - start;
+        scrapes++;
+
+        int headerLength = snprintf(header, sizeof(header),
+            "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\n\r\n", bodyLength);
+        if (write(client, header, headerLength) == -1 || write(client, body, bodyLength) == -1) {
+            perror(YELLOW "write scrape" RESET);
+        }
+        close(client);
+    }
+
+    close(server);
+    unlink(socketPath);
+    printf(GREEN "Served %lld scrapes, %.2f us rendering per scrape." RESET "\n", scrapes, scrapes ? renderNs / 1e3 / scrapes : 0.0);
+}
+
+
+void benchmarkScrapes(const char *socketPath, int scrapes) {
+/*
+ * Scrapes a running sidecar repeatedly and reports the round-trip cost per scrape.
+*/
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+
+    const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+    char response[METRICS_BUFFER_SIZE + 256];
+    long long totalNs = 0, worstNs = 0;
+
+    for (int i = 0; i < scrapes; i++) {
+        long long start = getMonotonicTimeNs();
+
+        int client = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (client == -1 || connect(client, (struct sockaddr *)&address, sizeof(address)) == -1) {
+            perror(RED "connect metrics socket" RESET);
+            exit(EXIT_FAILURE);
+        }
+        if (write(client, request, strlen(request)) == -1) {
+            perror(RED "write request" RESET);
+            exit(EXIT_FAILURE);
+        }
+        while (read(client, response, sizeof(response)) > 0) {}
+        close(client);
+
+        long long elapsed = getMonotonicTimeNs() - start;
+        totalNs += elapsed;
+        if (elapsed > worstNs) worstNs = elapsed;
+    }
+
+    printf("%d scrapes: mean %.1f us, worst %.1f us per scrape.\n", scrapes, totalNs / 1e3 / scrapes, worstNs / 1e3);
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *socketPath = METRICS_SOCKET_PATH;
+    int benchmark = 0, opt;
+
+    while ((opt = getopt(argc, argv, "s:b:")) != -1) {
+        if (opt == 's') {
+            socketPath = optarg;
+        } else if (opt == 'b') {
+            benchmark = atoi(optarg);
+        } else {
+            fprintf(stderr, RED "Usage: %s [-s socketPath] [-b scrapes]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (benchmark > 0) {
+        benchmarkScrapes(socketPath, benchmark);
+        return 0;
+    }
+
+    struct sigaction sa;
+    sa.sa_handler = handleStop;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0; // no SA_RESTART, so accept() returns on a stop request
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    serveMetrics(socketPath);
+    return 0;
+}
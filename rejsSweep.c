@@ -0,0 +1,462 @@
+#include "utils.h"
+
+/*
+ * rejs-sweep: runs the whole simulation over a grid of ship capacity (N), bridge capacity (K),
+ * passenger count and spawn rate, and writes one CSV row per run. N and K are compile-time
+ * settings, so the simulation binaries are rebuilt for every (N, K) pair and rebuilt with the
+ * defaults once the sweep is done.
+ *
+ * Usage: rejs-sweep [-n N,...] [-k K,...] [-g gangways,...] [-O global|gangway] [-p passengers,...] [-r passengersPerSecond,...]
+ *                   [-i "rejs options"] [-o csvPath]
+ * After the sweep, the knee of every curve (boardings/s over passengers, and over spawn rate
+ * when several rates are swept) is printed: the point after which adding load stops paying off.
+ *
+ * With -i, every point is run twice, as is and with the given rejs placement options
+ * (e.g. -i "-C 1 -N -10 -P 2-7"), and the ship captain's run queue delay, boarding p99
+ * and dock turnaround of both are compared at the end. -i "-L" compares the two-lane bridge,
+ * -i "-Q sysv" the SysV request queue against the shared-memory request ring.
+ *
+ * With -g, every point is run with each number of gangways (rejs -G, boarding order from -O),
+ * and the loading rate of each is compared with the first: a gain that stalls while the ship
+ * captain's CPU is saturated means the captain, not the bridge, limits loading.
+*/
+
+#define MAX_GRID_VALUES 16
+#define MAX_ISOLATION_ARGS 16
+#define RUN_TIMEOUT_S 300
+#define RUN_REPORT_PATH "/tmp/rejs-sweep.run"
+#define REPORT_FIELDS 20
+
+typedef struct {
+    int shipCapacity, bridgeCapacity, gangways, passengers, spawnRate, isolated;
+    int ok;
+    double wallS, captainCpuS, totalCpuS;
+    long voluntaryCs, involuntaryCs;
+    long long boarded, voyages;
+    double captainRunDelayMs;
+    long long captainTimeslices, boardingP99Us;
+    double turnaroundMs; // Mean arrival -> departure
+    double requestedRate, achievedRate;
+    double wastedTripsPerVoyage;
+    double captainRequestsPerS, requestDelayUs, syscallsPerRequest; // Passenger -> captain requests
+    double loadingRate; // Boardings per second of loading window
+    double captainReadyMs, firstBoardingMs; // Cold start, from launch, -1 if never
+} SweepResult;
+
+static char *isolationArgs[MAX_ISOLATION_ARGS]; // Extra rejs options of isolated runs
+static int isolationArgCount;
+static const char *gangwayOrder = "global"; // Boarding order over several gangways, rejs -G
+
+
+int parseList(const char *text, int values[]) {
+/*
+  * Parses a comma separated list of non-negative integers.
+  *
+  * @return Number of values read.
+*/
+
+    int count = 0;
+    const char *p = text;
+    while (*p != '\0' && count < MAX_GRID_VALUES) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value < 0) {
+            fprintf(stderr, RED "Bad list \"%s\"." RESET "\n", text);
+            exit(EXIT_FAILURE);
+        }
+        values[count++] = value;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+
+int buildSimulation(int shipCapacity, int bridgeCapacity) {
+/*
+  * Rebuilds the simulation binaries, with the given N and K or the defaults if both are 0.
+  *
+  * @return 1 if the build succeeded.
+*/
+
+    char command[256];
+    if (shipCapacity == 0 && bridgeCapacity == 0) {
+        snprintf(command, sizeof(command), "make -s -B simulation > /dev/null");
+    } else {
+        snprintf(command, sizeof(command), "make -s -B simulation DEFINES='-DSHIP_CAPACITY=%d -DBRIDGE_CAPACITY=%d' > /dev/null",
+                 shipCapacity, bridgeCapacity);
+    }
+    return system(command) == 0;
+}
+
+
+void splitIsolationArgs(char *text) {
+    // Splits the -i value into separate rejs arguments, in place
+    for (char *arg = strtok(text, " "); arg != NULL && isolationArgCount < MAX_ISOLATION_ARGS; arg = strtok(NULL, " ")) {
+        isolationArgs[isolationArgCount++] = arg;
+    }
+}
+
+
+int readRunReport(SweepResult *result) {
+/*
+  * Reads the key=value run report rejs writes. Keys it does not know are skipped,
+  * so rejs can add fields without breaking older sweeps.
+  *
+  * @return 1 (also set in result->ok) if the report has this version and every field.
+*/
+
+    static const char *keys[REPORT_FIELDS] = {
+        "wallS", "captainCpuS", "totalCpuS", "voluntaryCs", "involuntaryCs", "boarded", "voyages",
+        "captainRunDelayMs", "captainTimeslices", "boardingP99Us", "turnaroundMs", "requestedRate", "achievedRate",
+        "wastedTripsPerVoyage", "captainRequestsPerS", "requestDelayUs", "syscallsPerRequest", "loadingRate",
+        "captainReadyMs", "firstBoardingMs"
+    };
+    double values[REPORT_FIELDS];
+    int found[REPORT_FIELDS] = {0};
+    int version = 0;
+
+    FILE *report = fopen(RUN_REPORT_PATH, "r");
+    if (report == NULL) {
+        fprintf(stderr, RED "=== Sweep ===" RESET " rejs left no run report.\n");
+        return 0;
+    }
+    char line[128], key[64];
+    double value;
+    while (fgets(line, sizeof(line), report) != NULL) {
+        if (sscanf(line, "%63[^=]=%lf", key, &value) != 2) continue;
+        if (strcmp(key, "version") == 0) version = (int)value;
+        for (int i = 0; i < REPORT_FIELDS; i++) {
+            if (strcmp(key, keys[i]) == 0) {
+                values[i] = value;
+                found[i] = 1;
+            }
+        }
+    }
+    fclose(report);
+
+    if (version != RUN_REPORT_VERSION) {
+        fprintf(stderr, RED "=== Sweep ===" RESET " run report has version %d, expected %d.\n", version, RUN_REPORT_VERSION);
+        return 0;
+    }
+    for (int i = 0; i < REPORT_FIELDS; i++) {
+        if (!found[i]) {
+            fprintf(stderr, RED "=== Sweep ===" RESET " run report lacks %s.\n", keys[i]);
+            return 0;
+        }
+    }
+
+    result->wallS = values[0];
+    result->captainCpuS = values[1];
+    result->totalCpuS = values[2];
+    result->voluntaryCs = values[3];
+    result->involuntaryCs = values[4];
+    result->boarded = values[5];
+    result->voyages = values[6];
+    result->captainRunDelayMs = values[7];
+    result->captainTimeslices = values[8];
+    result->boardingP99Us = values[9];
+    result->turnaroundMs = values[10];
+    result->requestedRate = values[11];
+    result->achievedRate = values[12];
+    result->wastedTripsPerVoyage = values[13];
+    result->captainRequestsPerS = values[14];
+    result->requestDelayUs = values[15];
+    result->syscallsPerRequest = values[16];
+    result->loadingRate = values[17];
+    result->captainReadyMs = values[18];
+    result->firstBoardingMs = values[19];
+    result->ok = 1;
+    return 1;
+}
+
+
+void runOnce(SweepResult *result) {
+/*
+  * Runs one simulated day and fills in the result from the run report rejs writes.
+  * The harbour captain gets "q" on stdin, so nobody signals the ship captain.
+*/
+
+    int harbourInput[2];
+    if (pipe(harbourInput) == -1) {
+        perror(RED "pipe" RESET);
+        exit(EXIT_FAILURE);
+    }
+    if (write(harbourInput[1], "q\n", 2) == -1) perror(YELLOW "write harbour input" RESET);
+    close(harbourInput[1]);
+
+    char passengerArg[16], rateArg[16], gangwayArg[32];
+    snprintf(passengerArg, sizeof(passengerArg), "%d", result->passengers);
+    snprintf(rateArg, sizeof(rateArg), "%d", result->spawnRate);
+    snprintf(gangwayArg, sizeof(gangwayArg), "%d:%s", result->gangways, gangwayOrder);
+    unlink(RUN_REPORT_PATH);
+
+    pid_t rejsPid = fork();
+    if (rejsPid == -1) {
+        perror(RED "fork rejs-sweep" RESET);
+        exit(EXIT_FAILURE);
+    } else if (rejsPid == 0) {
+        setpgid(0, 0); // Own process group, so a hung simulation can be taken down whole
+        dup2(harbourInput[0], STDIN_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        char *rejsArgv[10 + MAX_ISOLATION_ARGS] = {"./rejs", "-p", passengerArg, "-r", rateArg, "-o", RUN_REPORT_PATH, "-G", gangwayArg};
+        for (int i = 0; result->isolated && i < isolationArgCount; i++) rejsArgv[9 + i] = isolationArgs[i];
+        execv(rejsArgv[0], rejsArgv);
+        perror(RED "execv rejs" RESET);
+        exit(EXIT_FAILURE);
+    }
+    close(harbourInput[0]);
+
+    long long startNs = getMonotonicTimeNs();
+    int finished = 0;
+    while (!finished && (getMonotonicTimeNs() - startNs) / 1000000000LL < RUN_TIMEOUT_S) {
+        finished = waitpid(rejsPid, NULL, WNOHANG) == rejsPid;
+        if (!finished) usleep(50000);
+    }
+    if (!finished) {
+        fprintf(stderr, RED "=== Sweep ===" RESET " run did not finish within %d s, killing it.\n", RUN_TIMEOUT_S);
+        kill(-rejsPid, SIGKILL);
+        waitpid(rejsPid, NULL, 0);
+        removeLeftoverResources();
+        return;
+    }
+
+    readRunReport(result);
+}
+
+
+double boardingsPerSecond(const SweepResult *result) {
+    return result->wallS > 0 ? result->boarded / result->wallS : 0;
+}
+
+
+double meanLoadFactor(const SweepResult *result) {
+    return result->voyages > 0 ? (double)result->boarded / result->voyages / result->shipCapacity : 0;
+}
+
+
+double captainMeanWaitUs(const SweepResult *result) {
+    // Mean run queue delay of the ship captain per timeslice
+    return result->captainTimeslices > 0 ? result->captainRunDelayMs * 1000 / result->captainTimeslices : 0;
+}
+
+
+int findKnee(const double x[], const double y[], int count) {
+/*
+  * Finds the knee of a rising curve: with both axes scaled to 0..1, the point furthest
+  * above the straight line from the first to the last point.
+  *
+  * @return Index of the knee, -1 if the curve has fewer than 3 points or does not bend.
+*/
+
+    if (count < 3 || x[count - 1] == x[0]) return -1;
+
+    double minY = y[0], maxY = y[0];
+    for (int i = 1; i < count; i++) {
+        if (y[i] < minY) minY = y[i];
+        if (y[i] > maxY) maxY = y[i];
+    }
+    if (maxY == minY) return -1;
+
+    int knee = -1;
+    double best = 0;
+    for (int i = 1; i < count - 1; i++) {
+        double xs = (x[i] - x[0]) / (x[count - 1] - x[0]);
+        double ys = (y[i] - minY) / (maxY - minY);
+        if (ys - xs > best) {
+            best = ys - xs;
+            knee = i;
+        }
+    }
+    return knee;
+}
+
+
+void printKnee(const char *curve, const char *axis, int overRate, SweepResult *const points[], int count) {
+    double x[MAX_GRID_VALUES], y[MAX_GRID_VALUES], peak = 0;
+    int used = 0;
+    for (int i = 0; i < count; i++) {
+        if (!points[i]->ok) continue;
+        x[used] = overRate ? points[i]->spawnRate : points[i]->passengers;
+        y[used] = boardingsPerSecond(points[i]);
+        if (y[used] > peak) peak = y[used];
+        used++;
+    }
+
+    int knee = findKnee(x, y, used);
+    if (knee == -1) {
+        printf(CYAN "=== Sweep ===" RESET " %s: no knee over %s (%d points)\n", curve, axis, used);
+    } else {
+        printf(CYAN "=== Sweep ===" RESET " %s: knee at %.0f %s, %.1f boardings/s (%.0f%% of peak %.1f)\n",
+               curve, x[knee], axis, y[knee], 100 * y[knee] / peak, peak);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    int ships[MAX_GRID_VALUES] = {25, 50}, bridges[MAX_GRID_VALUES] = {5, 10};
+    int passengers[MAX_GRID_VALUES] = {250, 500, 1000, 2000}, rates[MAX_GRID_VALUES] = {0};
+    int gangways[MAX_GRID_VALUES] = {1};
+    int shipCount = 2, bridgeCount = 2, gangwayCount = 1, passengerCount = 4, rateCount = 1, isolationCount = 1, opt;
+    const char *csvPath = "sweep.csv";
+
+    while ((opt = getopt(argc, argv, "n:k:g:O:p:r:i:o:")) != -1) {
+        if (opt == 'n') shipCount = parseList(optarg, ships);
+        else if (opt == 'k') bridgeCount = parseList(optarg, bridges);
+        else if (opt == 'g') gangwayCount = parseList(optarg, gangways);
+        else if (opt == 'O' && (strcmp(optarg, "global") == 0 || strcmp(optarg, "gangway") == 0)) gangwayOrder = optarg;
+        else if (opt == 'p') passengerCount = parseList(optarg, passengers);
+        else if (opt == 'r') rateCount = parseList(optarg, rates);
+        else if (opt == 'o') csvPath = optarg;
+        else if (opt == 'i') {
+            splitIsolationArgs(optarg);
+            isolationCount = 2;
+        } else {
+            fprintf(stderr, RED "Usage: %s [-n N,...] [-k K,...] [-g gangways,...] [-O global|gangway] [-p passengers,...] [-r passengersPerSecond,...] "
+                    "[-i \"rejs options\"] [-o csvPath]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (int g = 0; g < gangwayCount; g++) {
+        if (gangways[g] < 1 || gangways[g] > MAX_GANGWAYS) {
+            fprintf(stderr, RED "Gangways must be between 1 and %d." RESET "\n", MAX_GANGWAYS);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    FILE *csv = fopen(csvPath, "w");
+    if (csv == NULL) {
+        perror(RED "fopen csv" RESET);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(csv, "ship_capacity,bridge_capacity,gangways,passengers,spawn_rate,isolated,wall_s,boardings_per_s,mean_load_factor,"
+                 "captain_cpu_percent,total_cpu_s,voluntary_cs,involuntary_cs,voyages,captain_run_delay_ms,captain_mean_wait_us,boarding_p99_us,mean_turnaround_ms,achieved_spawn_rate,wasted_trips_per_voyage,"
+                 "captain_requests_per_s,request_queueing_delay_us,captain_syscalls_per_request,loading_boardings_per_s,"
+                 "captain_ready_ms,first_boarding_ms\n");
+
+    int groupCount = shipCount * bridgeCount * gangwayCount * isolationCount;
+    SweepResult *results = calloc(groupCount * passengerCount * rateCount, sizeof(SweepResult));
+    if (results == NULL) {
+        perror(RED "calloc" RESET);
+        exit(EXIT_FAILURE);
+    }
+    // results[((((n * bridgeCount + k) * gangwayCount + g) * isolationCount + i) * rateCount + r) * passengerCount + p]
+
+    removeLeftoverResources();
+    for (int n = 0; n < shipCount; n++) {
+        for (int k = 0; k < bridgeCount; k++) {
+            if (bridges[k] < 1 || bridges[k] >= ships[n]) {
+                printf(YELLOW "=== Sweep ===" RESET " N=%d K=%d skipped, K must be between 1 and N-1.\n", ships[n], bridges[k]);
+                continue;
+            }
+            if (!buildSimulation(ships[n], bridges[k])) {
+                fprintf(stderr, RED "=== Sweep ===" RESET " build for N=%d K=%d failed, skipped.\n", ships[n], bridges[k]);
+                continue;
+            }
+
+            for (int g = 0; g < gangwayCount; g++) {
+                for (int i = 0; i < isolationCount; i++) {
+                    SweepResult *group = &results[(((n * bridgeCount + k) * gangwayCount + g) * isolationCount + i) * rateCount * passengerCount];
+                    for (int r = 0; r < rateCount; r++) {
+                        for (int p = 0; p < passengerCount; p++) {
+                            SweepResult *result = &group[r * passengerCount + p];
+                            result->shipCapacity = ships[n];
+                            result->bridgeCapacity = bridges[k];
+                            result->gangways = gangways[g];
+                            result->passengers = passengers[p];
+                            result->spawnRate = rates[r];
+                            result->isolated = i;
+
+                            printf(CYAN "=== Sweep ===" RESET " N=%d K=%d G=%d passengers=%d rate=%d/s%s ... ", ships[n], bridges[k], gangways[g], passengers[p], rates[r],
+                                   i ? " isolated" : "");
+                            fflush(stdout);
+                            runOnce(result);
+                            if (!result->ok) {
+                                printf(RED "failed" RESET "\n");
+                                continue;
+                            }
+
+                            printf("%.1f boardings/s in %.1f s, boarding p99 %lld us\n", boardingsPerSecond(result), result->wallS, result->boardingP99Us);
+                            fprintf(csv, "%d,%d,%d,%d,%d,%d,%.3f,%.3f,%.3f,%.1f,%.3f,%ld,%ld,%lld,%.3f,%.1f,%lld,%.1f,%.2f,%.2f,%.1f,%.1f,%.3f,%.3f,%.3f,%.3f\n",
+                                    ships[n], bridges[k], gangways[g], passengers[p], rates[r], i,
+                                    result->wallS, boardingsPerSecond(result), meanLoadFactor(result),
+                                    100 * result->captainCpuS / result->wallS, result->totalCpuS,
+                                    result->voluntaryCs, result->involuntaryCs, result->voyages,
+                                    result->captainRunDelayMs, captainMeanWaitUs(result), result->boardingP99Us, result->turnaroundMs, result->achievedRate, result->wastedTripsPerVoyage,
+                                    result->captainRequestsPerS, result->requestDelayUs, result->syscallsPerRequest, result->loadingRate,
+                                    result->captainReadyMs, result->firstBoardingMs);
+                            fflush(csv);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    fclose(csv);
+
+    if (!buildSimulation(0, 0)) {
+        fprintf(stderr, YELLOW "=== Sweep ===" RESET " rebuilding with the default N and K failed.\n");
+    }
+
+    printf(CYAN "=== Sweep ===" RESET " results written to %s\n", csvPath);
+    for (int g = 0; g < groupCount; g++) {
+        SweepResult *group = &results[g * rateCount * passengerCount];
+        if (group[0].shipCapacity == 0) continue; // Skipped or not built
+        char curve[64];
+        SweepResult *points[MAX_GRID_VALUES];
+        const char *variant = group[0].isolated ? " isolated" : "";
+
+        for (int r = 0; r < rateCount; r++) {
+            snprintf(curve, sizeof(curve), "N=%d K=%d G=%d rate=%d/s%s", group[0].shipCapacity, group[0].bridgeCapacity, group[0].gangways, rates[r], variant);
+            for (int p = 0; p < passengerCount; p++) points[p] = &group[r * passengerCount + p];
+            printKnee(curve, "passengers", 0, points, passengerCount);
+        }
+        for (int p = 0; rateCount > 1 && p < passengerCount; p++) {
+            snprintf(curve, sizeof(curve), "N=%d K=%d G=%d passengers=%d%s", group[0].shipCapacity, group[0].bridgeCapacity, group[0].gangways, passengers[p], variant);
+            for (int r = 0; r < rateCount; r++) points[r] = &group[r * passengerCount + p];
+            printKnee(curve, "passengers/s", 1, points, rateCount);
+        }
+    }
+
+    // Same point as is and isolated side by side
+    for (int g = 0; isolationCount == 2 && g < groupCount; g += 2) {
+        for (int j = 0; j < rateCount * passengerCount; j++) {
+            SweepResult *plain = &results[g * rateCount * passengerCount + j], *isolated = plain + rateCount * passengerCount;
+            if (!plain->ok || !isolated->ok) continue;
+            printf(CYAN "=== Isolation ===" RESET " N=%d K=%d G=%d passengers=%d rate=%d/s: captain wait %.1f -> %.1f us/slice, boarding p99 %lld -> %lld us, turnaround %.0f -> %.0f ms, "
+                   "captain %.0f -> %.0f requests/s, request queueing %.1f -> %.1f us\n",
+                   plain->shipCapacity, plain->bridgeCapacity, plain->gangways, plain->passengers, plain->spawnRate,
+                   captainMeanWaitUs(plain), captainMeanWaitUs(isolated), plain->boardingP99Us, isolated->boardingP99Us,
+                   plain->turnaroundMs, isolated->turnaroundMs, plain->captainRequestsPerS, isolated->captainRequestsPerS,
+                   plain->requestDelayUs, isolated->requestDelayUs);
+        }
+    }
+
+    // Loading rate of the same point over each number of gangways, against the first
+    int pointsPerGangway = isolationCount * rateCount * passengerCount;
+    for (int nk = 0; gangwayCount > 1 && nk < shipCount * bridgeCount; nk++) {
+        SweepResult *first = &results[nk * gangwayCount * pointsPerGangway];
+        for (int j = 0; j < pointsPerGangway; j++) {
+            if (!first[j].ok || first[j].loadingRate <= 0) continue;
+            printf(CYAN "=== Gangways ===" RESET " N=%d K=%d passengers=%d rate=%d/s%s, %s order:", first[j].shipCapacity, first[j].bridgeCapacity,
+                   first[j].passengers, first[j].spawnRate, first[j].isolated ? " isolated" : "", gangwayOrder);
+            SweepResult *previous = &first[j];
+            for (int g = 0; g < gangwayCount; g++) {
+                SweepResult *point = &first[g * pointsPerGangway + j];
+                if (!point->ok) {
+                    printf(" G=%d failed%s", gangways[g], g + 1 < gangwayCount ? "," : "\n");
+                    continue;
+                }
+                double captainCpu = point->wallS > 0 ? 100 * point->captainCpuS / point->wallS : 0;
+                // Less than 10% more than the previous count while the captain is nearly always on CPU
+                int captainBound = g > 0 && point->loadingRate < 1.1 * previous->loadingRate && captainCpu >= 80;
+                printf(" G=%d %.1f boardings/s x%.2f (captain %.0f%% CPU%s)%s", gangways[g], point->loadingRate, point->loadingRate / first[j].loadingRate,
+                       captainCpu, captainBound ? ", captain-bound" : "", g + 1 < gangwayCount ? "," : "\n");
+                previous = point;
+            }
+        }
+    }
+
+    free(results);
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "utils.h"
+#include "shared_region.h"
+#include "registry.h"
+#include <sys/resource.h>
+
+/*
+ * rejs-top: live view of a running simulation.
+ * Maps the shared region read-only and never takes SEM_MUTEX, so it cannot
+ * delay the captain or the passengers; values are sampled as they are.
+ *
+ * Usage: rejs-top [-i intervalMs] [-n refreshes]
+*/
+
+static volatile sig_atomic_t stopRequested = 0;
+static const char *phaseNames[] = PHASE_NAMES;
+static const char *registryStateNames[] = REGISTRY_STATE_NAMES;
+
+
+void handleStop(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+
+double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+int main(int argc, char *argv[]) {
+    int intervalMs = 500, refreshLimit = -1, opt;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+        if (opt == 'i') {
+            intervalMs = atoi(optarg);
+        } else if (opt == 'n') {
+            refreshLimit = atoi(optarg);
+        } else {
+            fprintf(stderr, RED "Usage: %s [-i intervalMs] [-n refreshes]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (intervalMs < 10) intervalMs = 10;
+
+    struct sigaction sa;
+    sa.sa_handler = handleStop;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    const RegionHeader *region = attachPublishedRegionReadOnly();
+    const SharedMemory *sm = findRegionSection(region, SECTION_SHARED_MEMORY);
+    const LiveStats *live = findRegionSection(region, SECTION_LIVE_STATS);
+    const PassengerRegistry *registry = findRegionSection(region, SECTION_REGISTRY);
+    if (sm == NULL || live == NULL || registry == NULL) {
+        fprintf(stderr, RED "Shared region is missing sections." RESET "\n");
+        exit(EXIT_FAILURE);
+    }
+
+    long long startNs = getMonotonicTimeNs(), lastNs = startNs;
+    long long lastBoarded = live->boardedTotal, lastDenied = live->deniedTotal, lastLoops = live->captainLoops;
+    struct timespec interval = {intervalMs / 1000, (intervalMs % 1000) * 1000000L};
+
+    for (int refresh = 0; !stopRequested && refresh != refreshLimit; refresh++) {
+        nanosleep(&interval, NULL);
+
+        long long nowNs = getMonotonicTimeNs();
+        double seconds = (nowNs - lastNs) / 1e9;
+        long long boarded = live->boardedTotal, denied = live->deniedTotal, loops = live->captainLoops;
+        int phase = live->phase;
+
+        printf("\033[H\033[2J" CYAN "rejs-top" RESET " every %d ms, read-only\n\n", intervalMs);
+        printf("voyages done  %d / %d, phase: %s\n", sm->currentVoyage, NUMBER_OF_TRIPS_PER_DAY,
+               phase >= PHASE_STARTING && phase <= PHASE_FINISHED ? phaseNames[phase] : "?");
+        printf("ship          %3d / %d\n", sm->peopleOnShip, SHIP_CAPACITY);
+        if (sm->twoLaneBridge) {
+            printf("bridge        %3d / %d  towards ship, %d / %d towards land\n", sm->peopleOnBridge, sm->gangways * BRIDGE_CAPACITY,
+                   sm->peopleOnBridgeInbound, BRIDGE_INBOUND_CAPACITY);
+        } else {
+            printf("bridge        %3d / %d  (%s)\n", sm->peopleOnBridge, sm->gangways * BRIDGE_CAPACITY, sm->queueDirection == 1 ? "towards land" : "towards ship");
+        }
+        if (sm->gangways > 1) {
+            printf("gangways     ");
+            for (int g = 0; g < sm->gangways; g++) {
+                printf(" %d / %d (%lld boarded)%s", sm->peopleOnGangway[g], BRIDGE_CAPACITY, live->boardedOnGangway[g], g + 1 < sm->gangways ? "," : "");
+            }
+            printf(", %s order\n", sm->gangwayOrder == GANGWAY_ORDER_GANGWAY ? "per-gangway" : "global");
+        }
+        printf("queue depth   %d, reservations ashore %d\n", live->queueDepth, live->reservationsWaiting);
+        if (live->dockIdles > 0) {
+            printf("dock idle     %8.1f ms last, %.1f ms mean, %lld tickets taken ashore\n", live->lastDockIdleNs / 1e6,
+                   live->dockIdleNs / 1e6 / live->dockIdles, live->ticketsIssued);
+        }
+        printf("boarding      %8.1f /s  (total %lld)\n", (boarded - lastBoarded) / seconds, boarded);
+        printf("denials       %8.1f /s  (total %lld)\n", (denied - lastDenied) / seconds, denied);
+        printf("captain loop  %8.0f /s\n", (loops - lastLoops) / seconds);
+
+        // Census of the passenger processes, one pass over the registry
+        int census[REGISTRY_STATES];
+        int registered = registryCensus(registry, census);
+        printf("registry      %d / %d passengers:", registered, REGISTRY_SLOTS);
+        for (int state = REGISTRY_ASHORE; state < REGISTRY_STATES; state++) {
+            printf(" %s %d%s", registryStateNames[state], census[state], state + 1 < REGISTRY_STATES ? "," : "\n");
+        }
+        if (live->passengersReclaimed > 0) {
+            printf("reclaimed     %lld places from dead passengers\n", live->passengersReclaimed);
+        }
+        fflush(stdout);
+
+        lastNs = nowNs;
+        lastBoarded = boarded;
+        lastDenied = denied;
+        lastLoops = loops;
+
+        if (phase == PHASE_FINISHED) break;
+    }
+
+    // Own cost, to confirm the monitor does not disturb the run it watches
+    double wall = (getMonotonicTimeNs() - startNs) / 1e9;
+    double cpu = cpuSeconds();
+    printf("\nrejs-top used %.3f s CPU in %.1f s (%.3f%% of one core).\n", cpu, wall, wall > 0 ? 100.0 * cpu / wall : 0.0);
+    return 0;
+}
@@ -0,0 +1,291 @@
+#include "utils.h"
+#include "shared_region.h"
+#include "registry.h"
+
+/*
+ * rejs-torture: runs the whole simulation under heavy load with rejs-check alongside,
+ * injecting SIGUSR1 (and occasionally SIGUSR2) into the ship captain at random moments.
+ * With -k it also SIGKILLs passengers in the middle of crossing the bridge and times how
+ * long the captain takes to reclaim their place.
+ * Each run uses its own seed, printed so a failing run can be repeated, and is a cold start:
+ * the captain's startup and the time to the first boarding are printed for every run.
+ *
+ * Usage: rejs-torture [-p passengers] [-r runs] [-s seed] [-m meanSignalGapMs] [-e endOfDayPercent] [-k killsPerRun]
+ * Exits with 1 if any run had violations, did not finish, had a ship captain that did not report ready
+ * within STARTUP_TIMEOUT_MS or left a killed passenger's place unclaimed for longer than RECLAIM_BOUND_MS.
+*/
+
+#define RUN_TIMEOUT_S 300
+#define RECLAIM_BOUND_MS (20 * LEASE_CHECK_MS) // Lease check period plus the captain's wait for SEM_MUTEX under load
+
+static unsigned int randomState;
+
+
+int nextRandom(int bound) {
+    return rand_r(&randomState) % bound;
+}
+
+
+pid_t startProcess(char *const argv[], int stdinFd, int quiet) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror(RED "fork rejs-torture" RESET);
+        exit(EXIT_FAILURE);
+    } else if (pid == 0) {
+        setpgid(0, 0); // Own process group, so a hung simulation can be taken down whole
+        if (stdinFd != -1) dup2(stdinFd, STDIN_FILENO);
+        if (quiet) {
+            int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDOUT_FILENO);
+        }
+        execv(argv[0], argv);
+        perror(RED "execv rejs-torture" RESET);
+        exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+
+pid_t waitForCaptain(pid_t rejsPid, const RegionHeader **region) {
+/*
+  * Waits until the simulation started as rejsPid has published its region and the
+  * captain has reported ready, then returns the captain's PID (0 if rejs ended first
+  * or the captain was not ready within STARTUP_TIMEOUT_MS of the launch).
+  *
+  * @param region Receives the simulation's region, mapped read-only (NULL if it never appeared).
+*/
+
+    *region = NULL;
+    while (waitpid(rejsPid, NULL, WNOHANG) == 0) {
+        FILE *info = fopen(REGION_INFO_PATH, "r");
+        int ownerPid = 0, ownerFd;
+        if (info != NULL) {
+            if (fscanf(info, "%d %d", &ownerPid, &ownerFd) != 2) ownerPid = 0;
+            fclose(info);
+        }
+
+        if (ownerPid == rejsPid) {
+            *region = attachPublishedRegionReadOnly();
+            const SharedMemory *sm = findRegionSection(*region, SECTION_SHARED_MEMORY);
+            const LiveStats *live = findRegionSection(*region, SECTION_LIVE_STATS);
+            if (sm == NULL || live == NULL) {
+                return 0;
+            }
+            long long attachedNs = getMonotonicTimeNs();
+            while (sm->readyAtNs[ROLE_SHIP_CAPTAIN] == 0) {
+                long long sinceNs = sm->launchedAtNs > 0 ? sm->launchedAtNs : attachedNs; // rejs may not have launched anything yet
+                if (getMonotonicTimeNs() - sinceNs > STARTUP_TIMEOUT_MS * 1000000LL) {
+                    fprintf(stderr, RED "=== Torture ===" RESET " ship captain not ready within %d ms.\n", STARTUP_TIMEOUT_MS);
+                    return 0;
+                }
+                usleep(1000);
+            }
+            return live->captainPid;
+        }
+        usleep(10000);
+    }
+    return 0;
+}
+
+
+int killMidCrossing(const PassengerRegistry *registry, const LiveStats *live, long long *reclaimNs) {
+/*
+  * SIGKILLs a random passenger that is on the bridge, towards the ship or towards land,
+  * and waits until the captain has reclaimed its place and released its registry slot.
+  * Only while the captain runs: passengers still leave the ship on their own after it
+  * has ended the day at sea, and nobody reclaims anything then.
+  *
+  * @param reclaimNs Receives the time from the kill to the release [ns].
+  * @return 1 if reclaimed, 0 if nobody was crossing or the day ended first, -1 if not reclaimed within RECLAIM_BOUND_MS.
+*/
+
+    if (live->phase == PHASE_FINISHED) {
+        return 0;
+    }
+
+    int start = nextRandom(REGISTRY_SLOTS), slot = -1;
+    pid_t pid = 0;
+    for (int i = 0; i < REGISTRY_SLOTS && slot == -1; i++) {
+        const RegistrySlot *entry = &registry->slots[(start + i) % REGISTRY_SLOTS];
+        int state = atomic_load_explicit(&entry->state, memory_order_relaxed);
+        if ((state == REGISTRY_ON_BRIDGE || state == REGISTRY_LEAVING) && entry->pid > 0 && kill(entry->pid, SIGKILL) == 0) {
+            slot = (start + i) % REGISTRY_SLOTS;
+            pid = entry->pid;
+        }
+    }
+    if (slot == -1) {
+        return 0;
+    }
+
+    long long killedAtNs = getMonotonicTimeNs();
+    const RegistrySlot *entry = &registry->slots[slot];
+    while (atomic_load(&entry->state) != REGISTRY_FREE && entry->pid == pid) {
+        if (live->phase == PHASE_FINISHED) {
+            return 0; // Killed after the captain's last lease check
+        }
+        if (getMonotonicTimeNs() - killedAtNs > RECLAIM_BOUND_MS * 1000000LL) {
+            fprintf(stderr, RED "=== Torture ===" RESET " passenger %d killed in registry slot %d not reclaimed within %d ms\n", pid, slot, RECLAIM_BOUND_MS);
+            return -1;
+        }
+        usleep(1000);
+    }
+    *reclaimNs = getMonotonicTimeNs() - killedAtNs;
+    return 1;
+}
+
+
+int runOnce(int run, int passengers, unsigned int seed, int meanGapMs, int endOfDayPercent, int kills) {
+/*
+  * Runs one torture round.
+  *
+  * @param kills Passengers to kill mid-crossing.
+  * @return 0 if the day finished without violations.
+*/
+
+    randomState = seed;
+    printf(CYAN "=== Torture run %d ===" RESET " seed %u, %d passengers\n", run, seed, passengers);
+    fflush(stdout);
+
+    // harbourCaptain reads commands from stdin, keep a pipe open until the end
+    int harbourInput[2];
+    if (pipe(harbourInput) == -1) {
+        perror(RED "pipe" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    char passengerArg[16];
+    snprintf(passengerArg, sizeof(passengerArg), "%d", passengers);
+    char *rejsArgv[] = {"./rejs", "-p", passengerArg, NULL};
+    pid_t rejsPid = startProcess(rejsArgv, harbourInput[0], 1);
+    close(harbourInput[0]);
+
+    const RegionHeader *region;
+    pid_t captainPid = waitForCaptain(rejsPid, &region);
+    if (captainPid == 0) {
+        // A simulation without a captain never ends the day
+        fprintf(stderr, RED "=== Torture run %d ===" RESET " ship captain not ready, killing the simulation (rejs PID %d).\n", run, rejsPid);
+        kill(-rejsPid, SIGKILL);
+        waitpid(rejsPid, NULL, 0);
+        close(harbourInput[1]);
+        if (region != NULL) unmapSharedRegion((RegionHeader *)region);
+        printf(CYAN "=== Torture run %d ===" RESET " NOT READY\n", run);
+        return 1;
+    }
+    const PassengerRegistry *registry = findRegionSection(region, SECTION_REGISTRY);
+    const LiveStats *live = findRegionSection(region, SECTION_LIVE_STATS);
+    const SharedMemory *shared = findRegionSection(region, SECTION_SHARED_MEMORY);
+    // Cold start, from rejs launching the roles, copied now: the region goes away with rejs
+    double captainReadyMs = (shared->readyAtNs[ROLE_SHIP_CAPTAIN] - shared->launchedAtNs) / 1e6;
+    double firstBoardingMs = -1;
+    char *checkArgv[] = {"./rejs-check", NULL};
+    pid_t checkPid = startProcess(checkArgv, -1, 0);
+
+    long long startNs = getMonotonicTimeNs();
+    int early = 0, endOfDay = 0, finished = 0, timedOut = 0;
+    int killed = 0, leaked = 0;
+    long long reclaimNs, worstReclaimNs = 0, totalReclaimNs = 0;
+
+    while (!finished) {
+        usleep((nextRandom(2 * meanGapMs) + 1) * 1000);
+        if (firstBoardingMs < 0 && live != NULL && live->firstBoardingNs > 0) {
+            firstBoardingMs = (live->firstBoardingNs - shared->launchedAtNs) / 1e6;
+        }
+
+        if (waitpid(rejsPid, NULL, WNOHANG) == rejsPid) {
+            finished = 1;
+            break;
+        }
+        if ((getMonotonicTimeNs() - startNs) / 1000000000LL > RUN_TIMEOUT_S) {
+            timedOut = 1;
+            break;
+        }
+
+        if (captainPid > 0 && !endOfDay && kill(captainPid, 0) == 0) {
+            if (nextRandom(100) < endOfDayPercent) {
+                kill(captainPid, SIGUSR2);
+                endOfDay = 1;
+            } else {
+                kill(captainPid, SIGUSR1);
+                early++;
+            }
+        }
+
+        if (registry != NULL && live != NULL && killed < kills) {
+            int result = killMidCrossing(registry, live, &reclaimNs);
+            if (result == -1) {
+                leaked++;
+                killed++;
+            } else if (result == 1) {
+                killed++;
+                totalReclaimNs += reclaimNs;
+                if (reclaimNs > worstReclaimNs) worstReclaimNs = reclaimNs;
+            }
+        }
+
+        // Once the captain is done, let the harbour captain go too
+        if (captainPid > 0 && kill(captainPid, 0) == -1 && harbourInput[1] != -1) {
+            if (write(harbourInput[1], "q\n", 2) == -1) perror(YELLOW "write harbour input" RESET);
+            close(harbourInput[1]);
+            harbourInput[1] = -1;
+        }
+    }
+
+    if (harbourInput[1] != -1) {
+        if (write(harbourInput[1], "q\n", 2) == -1) perror(YELLOW "write harbour input" RESET);
+        close(harbourInput[1]);
+    }
+
+    if (timedOut) {
+        fprintf(stderr, RED "=== Torture run %d ===" RESET " did not finish within %d s, killing it (rejs PID %d).\n", run, RUN_TIMEOUT_S, rejsPid);
+        kill(-rejsPid, SIGKILL);
+        waitpid(rejsPid, NULL, 0);
+        removeLeftoverResources();
+    }
+
+    int checkStatus = 0;
+    if (checkPid > 0) {
+        if (timedOut) kill(checkPid, SIGTERM);
+        waitpid(checkPid, &checkStatus, 0);
+    }
+    int violations = checkPid > 0 && WIFEXITED(checkStatus) && WEXITSTATUS(checkStatus) != 0;
+    unmapSharedRegion((RegionHeader *)region);
+
+    if (killed > 0) {
+        printf(CYAN "=== Torture run %d ===" RESET " %d passengers killed mid-crossing, place reclaimed after %.1f ms on average, %.1f ms at worst, %d not within %d ms\n",
+               run, killed, killed > leaked ? totalReclaimNs / 1e6 / (killed - leaked) : 0.0, worstReclaimNs / 1e6, leaked, RECLAIM_BOUND_MS);
+    }
+    printf(CYAN "=== Torture run %d ===" RESET " cold start: ship captain ready after %.3f ms, ", run, captainReadyMs);
+    if (firstBoardingMs >= 0) printf("first boarding after %.3f ms\n", firstBoardingMs);
+    else printf("nobody boarded before the day ended\n");
+    printf(CYAN "=== Torture run %d ===" RESET " %.1f s, %d SIGUSR1, %s SIGUSR2: %s\n", run, (getMonotonicTimeNs() - startNs) / 1e9, early,
+           endOfDay ? "one" : "no", timedOut ? "HUNG" : violations ? "VIOLATIONS" : leaked ? "LEAKED" : "ok");
+    return timedOut || violations || leaked;
+}
+
+
+int main(int argc, char *argv[]) {
+    int passengers = 20000, runs = 3, meanGapMs = 300, endOfDayPercent = 5, kills = 0, opt;
+    unsigned int seed = time(NULL);
+
+    while ((opt = getopt(argc, argv, "p:r:s:m:e:k:")) != -1) {
+        if (opt == 'p') passengers = atoi(optarg);
+        else if (opt == 'r') runs = atoi(optarg);
+        else if (opt == 's') seed = strtoul(optarg, NULL, 10);
+        else if (opt == 'm') meanGapMs = atoi(optarg);
+        else if (opt == 'e') endOfDayPercent = atoi(optarg);
+        else if (opt == 'k') kills = atoi(optarg);
+        else {
+            fprintf(stderr, RED "Usage: %s [-p passengers] [-r runs] [-s seed] [-m meanSignalGapMs] [-e endOfDayPercent] [-k killsPerRun]" RESET "\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (meanGapMs < 1) meanGapMs = 1;
+
+    int failed = 0;
+    for (int run = 1; run <= runs; run++) {
+        failed += runOnce(run, passengers, seed + run - 1, meanGapMs, endOfDayPercent, kills);
+    }
+
+    printf(CYAN "=== Torture ===" RESET " %d of %d runs failed.\n", failed, runs);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+#include "utils.h"
+#include "request_ring.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/*
+ * Bounded lock-free ring carrying MSG_ENTER_BRIDGE / MSG_WANT_TO_BOARD requests from the
+ * passengers to the ship captain through the shared region. Producers claim a position
+ * with a compare-and-swap on head and publish the slot through its sequence number; the
+ * captain reads in order without any atomic read-modify-write. A captain that finds the
+ * ring empty sleeps on a futex, and only the first request after that wakes it, so a
+ * whole batch costs one wake-up instead of one syscall per message.
+ * The passenger engine uses a second ring the other way round, with the captain as the
+ * only producer and the engine as the consumer.
+*/
+
+
+void initializeRequestRing(RequestRing *ring) {
+/*
+  * Marks every slot free for the first lap. Called by rejs before any passenger starts.
+*/
+
+    atomic_init(&ring->head, 0);
+    ring->tail = 0;
+    atomic_init(&ring->consumerWaiting, 0);
+    for (unsigned int i = 0; i < REQUEST_RING_SLOTS; i++) {
+        atomic_init(&ring->slots[i].sequence, i);
+    }
+}
+
+
+int requestRingPush(RequestRing *ring, const BridgeMsg *msg) {
+/*
+  * Queues a request for the captain and wakes it if it sleeps.
+  *
+  * @param msg The request.
+  * @return 1 if queued, 0 if the ring is full.
+*/
+
+    unsigned int position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    RequestSlot *slot;
+
+    while (1) {
+        slot = &ring->slots[position & (REQUEST_RING_SLOTS - 1)];
+        int lag = (int)(atomic_load_explicit(&slot->sequence, memory_order_acquire) - position);
+
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            return 0; // The captain has not read this slot's previous lap yet
+        } else {
+            position = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    slot->msg = *msg;
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+    // Pairs with the store in requestRingWait(): either the consumer sees this request or we see it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->consumerWaiting, memory_order_relaxed) && atomic_exchange(&ring->consumerWaiting, 0)) {
+        syscall(SYS_futex, &ring->consumerWaiting, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+    return 1;
+}
+
+
+int requestRingPop(RequestRing *ring, BridgeMsg *msg) {
+/*
+  * Takes the oldest request. Consumer only.
+  *
+  * @param msg Receives the request.
+  * @return 1 if there was a published request, 0 otherwise.
+*/
+
+    RequestSlot *slot = &ring->slots[ring->tail & (REQUEST_RING_SLOTS - 1)];
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring->tail + 1) {
+        return 0;
+    }
+
+    *msg = slot->msg;
+    atomic_store_explicit(&slot->sequence, ring->tail + REQUEST_RING_SLOTS, memory_order_release);
+    ring->tail++;
+    return 1;
+}
+
+
+int requestRingWait(RequestRing *ring, long timeoutUs) {
+/*
+  * Sleeps until a request is published, a signal arrives or the timeout passes. Consumer only.
+  *
+  * @param timeoutUs Longest sleep [us].
+  * @return 1 if the consumer slept, 0 if a request was already waiting.
+*/
+
+    RequestSlot *slot = &ring->slots[ring->tail & (REQUEST_RING_SLOTS - 1)];
+
+    atomic_store(&ring->consumerWaiting, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == ring->tail + 1) {
+        atomic_store(&ring->consumerWaiting, 0);
+        return 0;
+    }
+
+    struct timespec timeout = {timeoutUs / 1000000, (timeoutUs % 1000000) * 1000};
+    syscall(SYS_futex, &ring->consumerWaiting, FUTEX_WAIT, 1, &timeout, NULL, 0);
+    atomic_store(&ring->consumerWaiting, 0);
+    return 1;
+}
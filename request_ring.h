@@ -0,0 +1,33 @@
+#ifndef REQUEST_RING_H
+#define REQUEST_RING_H
+
+#include <stdatomic.h>
+#include "bridge_queue.h"
+
+#define REQUEST_RING_SLOTS 1024    // Power of two
+#define REQUEST_RING_BATCH 256     // Requests the captain handles per drain
+#define REQUEST_RING_WAIT_US 1000  // Longest captain sleep on an empty ring, keeps its timers running
+
+// One request; sequence == position while free for a producer, position + 1 once it holds a request
+typedef struct {
+    atomic_uint sequence;
+    BridgeMsg msg;
+} RequestSlot;
+
+// Passenger -> ship captain requests, many producers and one consumer, in the "requests" section.
+// The same ring carries the captain's replies to the passenger engine in the "replies" section.
+typedef struct {
+    atomic_uint head;     // Next position a producer claims
+    char headPadding[64 - sizeof(atomic_uint)];
+    unsigned int tail;    // Next position the consumer reads, consumer only
+    atomic_int consumerWaiting; // Futex word, 1 while the consumer sleeps on an empty ring
+    char tailPadding[64 - sizeof(unsigned int) - sizeof(atomic_int)];
+    RequestSlot slots[REQUEST_RING_SLOTS];
+} RequestRing;
+
+void initializeRequestRing(RequestRing *ring);
+int requestRingPush(RequestRing *ring, const BridgeMsg *msg);
+int requestRingPop(RequestRing *ring, BridgeMsg *msg);
+int requestRingWait(RequestRing *ring, long timeoutUs);
+
+#endif
@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include "shared_region.h"
+#include "utils.h"
+#include <sys/mman.h>
+
+static size_t roundUp(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+
+int createSharedRegion(size_t size, int hugePages) {
+/*
+  * Creates an anonymous memory file for the shared region and writes its header.
+  * The region lives only as long as some process holds its descriptor or a mapping,
+  * so nothing is left behind after a crash. Children inherit the descriptor across exec.
+  *
+  * @param size Requested size of the region in bytes, header included.
+  * @param hugePages Non-zero to back the region with 2 MiB huge pages (falls back to normal pages).
+  * @return The file descriptor of the region.
+*/
+
+    int fd = -1;
+    RegionHeader *region = MAP_FAILED;
+    if (hugePages) {
+        size_t hugeSize = roundUp(size, REGION_HUGE_PAGE_SIZE);
+        fd = memfd_create("rejs-region", MFD_HUGETLB);
+        // ftruncate succeeds with an empty huge page pool, only mapping reserves the pages
+        if (fd != -1 && ftruncate(fd, hugeSize) == 0) {
+            region = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (region == MAP_FAILED) {
+            fprintf(stderr, YELLOW "Huge pages unavailable (%s), using normal pages." RESET "\n", strerror(errno));
+            if (fd != -1) close(fd);
+            fd = -1;
+            hugePages = 0;
+        } else {
+            size = hugeSize;
+        }
+    }
+
+    if (fd == -1) {
+        size = roundUp(size, sysconf(_SC_PAGESIZE));
+        fd = memfd_create("rejs-region", 0);
+        if (fd == -1) {
+            perror(RED "memfd_create" RESET);
+            exit(EXIT_FAILURE);
+        }
+        if (ftruncate(fd, size) == -1) {
+            perror(RED "ftruncate region" RESET);
+            exit(EXIT_FAILURE);
+        }
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (region == MAP_FAILED) {
+            perror(RED "mmap region" RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    memset(region, 0, sizeof(RegionHeader));
+    region->magic = REGION_MAGIC;
+    region->version = REGION_VERSION;
+    region->totalSize = size;
+    region->usedSize = roundUp(sizeof(RegionHeader), REGION_SECTION_ALIGNMENT);
+    region->hugePages = hugePages;
+    munmap(region, size);
+
+    return fd;
+}
+
+
+static RegionHeader* mapRegion(int fd, int protection) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        perror(RED "fstat region" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    RegionHeader *region = mmap(NULL, st.st_size, protection, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        perror(RED "mmap region" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    if (region->magic != REGION_MAGIC || region->version != REGION_VERSION || region->totalSize != (size_t)st.st_size) {
+        fprintf(stderr, RED "Descriptor %d is not a shared region of this version." RESET "\n", fd);
+        exit(EXIT_FAILURE);
+    }
+
+    return region;
+}
+
+
+RegionHeader* mapSharedRegion(int fd) {
+/*
+  * Maps a shared region created by createSharedRegion() into the process's address space.
+  *
+  * @param fd The file descriptor of the region.
+  * @return A pointer to the region header.
+*/
+
+    return mapRegion(fd, PROT_READ | PROT_WRITE);
+}
+
+
+const RegionHeader* mapSharedRegionReadOnly(int fd) {
+/*
+  * Maps a shared region without write access, for observers that must not disturb it.
+  *
+  * @param fd A descriptor of the region, may be opened O_RDONLY.
+  * @return A pointer to the region header.
+*/
+
+    return mapRegion(fd, PROT_READ);
+}
+
+
+void* addRegionSection(RegionHeader *region, const char *name, size_t size) {
+/*
+  * Carves a zeroed, cache-line aligned section out of the region and records it in the offset table.
+  * Only the creating process adds sections, before any child is started.
+  *
+  * @param region The mapped region.
+  * @param name Name under which other processes find the section.
+  * @param size Size of the section in bytes.
+  * @return A pointer to the section.
+*/
+
+    size_t offset = region->usedSize;
+    size_t end = roundUp(offset + size, REGION_SECTION_ALIGNMENT);
+
+    if (region->sectionCount >= REGION_MAX_SECTIONS || end > region->totalSize) {
+        fprintf(stderr, RED "No room left in the shared region for section '%s' (%zu bytes)." RESET "\n", name, size);
+        exit(EXIT_FAILURE);
+    }
+
+    RegionSection *section = &region->sections[region->sectionCount++];
+    snprintf(section->name, sizeof(section->name), "%s", name);
+    section->offset = offset;
+    section->size = size;
+    region->usedSize = end;
+
+    void *data = (char *)region + offset;
+    memset(data, 0, size);
+    return data;
+}
+
+
+void* findRegionSection(const RegionHeader *region, const char *name) {
+/*
+  * Looks a section up in the region's offset table.
+  *
+  * @param region The mapped region.
+  * @param name The name of the section.
+  * @return A pointer to the section, or NULL if there is none with that name.
+*/
+
+    for (int i = 0; i < region->sectionCount; i++) {
+        if (strncmp(region->sections[i].name, name, REGION_SECTION_NAME_LENGTH) == 0) {
+            return (char *)region + region->sections[i].offset;
+        }
+    }
+    return NULL;
+}
+
+
+void unmapSharedRegion(RegionHeader *region) {
+// Unmaps the shared region from the process's address space.
+
+    if (munmap(region, region->totalSize) == -1) {
+        perror(RED "munmap region" RESET);
+    }
+}
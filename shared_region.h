@@ -0,0 +1,38 @@
+#ifndef SHARED_REGION_H
+#define SHARED_REGION_H
+
+#include <stddef.h>
+
+#define REGION_MAGIC 0x52474E31U // "RGN1"
+#define REGION_VERSION 1
+#define REGION_MAX_SECTIONS 16
+#define REGION_SECTION_NAME_LENGTH 24
+#define REGION_SECTION_ALIGNMENT 64 // Cache line, so sections never share one
+#define REGION_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// Sub-region carved out of the shared region
+typedef struct {
+    char name[REGION_SECTION_NAME_LENGTH];
+    size_t offset; // From the start of the region
+    size_t size;
+} RegionSection;
+
+// Header at offset 0 of the shared region, followed by the sections
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    size_t totalSize;
+    size_t usedSize;
+    int hugePages;
+    int sectionCount;
+    RegionSection sections[REGION_MAX_SECTIONS];
+} RegionHeader;
+
+int createSharedRegion(size_t size, int hugePages);
+RegionHeader* mapSharedRegion(int fd);
+const RegionHeader* mapSharedRegionReadOnly(int fd);
+void* addRegionSection(RegionHeader *region, const char *name, size_t size);
+void* findRegionSection(const RegionHeader *region, const char *name);
+void unmapSharedRegion(RegionHeader *region);
+
+#endif
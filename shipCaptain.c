@@ -1,22 +1,70 @@
 #include "utils.h"
 #include "bridge_queue.h"
+#include "boarding.h"
 #include "shipCaptain.h"
+#include "checkpoint.h"
+#include "trace.h"
+#include "departure.h"
+#include "request_ring.h"
+#include "control.h"
+#include "registry.h"
+#include "ledger.h"
 
 
 volatile sig_atomic_t endOfDaySignal = 0; // Flag for sigusr2
+volatile sig_atomic_t pendingEarlyVoyage = 0, pendingEndOfDay = 0; // Signals not handled yet
 SharedMemory *sm;
+LiveStats *live; // Counters read by monitors without SEM_MUTEX
 
 int loaded = 0;
 
-int shmid, semid, msq_id;
+int regionFd, semid, msq_id;
 int earlyVoyage = 0;
 int signalReceived = 0;
 #define MAX_WAITING 2000
-
-// Data for handling queues
-static int globalSequenceCounter = 0; // Starting from 0, increments
-static int nextSequenceToBoard = 0; // Who is next to board the ship
-static pid_t waitingArray[MAX_WAITING]; // waitingArray[seq] = Passenger's PID (or 0)
+#define BOARDING_BATCH 64 // Actions carried out per pass of the state machine
+
+// Passenger denied on one voyage, boarded first on the next one
+typedef struct {
+    int slot;
+    int passengerClass;
+    int retries;
+} Reservation;
+
+// Carry-over reservations, kept across the queue reset in performDisembarkation()
+static Reservation carryOver[MAX_WAITING];
+static int carryOverHead = 0, carryOverCount = 0;
+
+// Statistics of the day, kept in the checkpoint across warm restarts
+static CaptainStats stats;
+static Checkpoint *checkpoint;
+
+static BoardingState *boarding; // Class queues of the voyage being loaded
+static ControlServer *control; // Control socket, see control.h
+static RequestRing *requestRing; // Bridge requests, NULL when they come over the SysV queue
+static PassengerRegistry *registry; // Who is where, one slot per passenger process
+static RequestRing *replyRing; // Replies to the passenger engine's records, NULL without the engine
+static const char *classNames[] = CLASS_NAMES;
+static const int classReservedSeats[] = CLASS_RESERVED_SEATS;
+static const int classLatencySlaMs[] = CLASS_LATENCY_SLA_MS;
+static const char *registryStateNames[] = REGISTRY_STATE_NAMES;
+
+static DeparturePolicy *departurePolicy;
+static long long dayStartNs; // When this captain started, for the daily throughput
+static long long arrivedAtNs = 0; // Last arrival in port, for the dock turnaround
+static long long dockReadyAtNs = 0; // Ship ready to load the next voyage and nobody boarded yet, for the dock idle time
+static int admissionClosedEarly = 0; // Bridge closed to newcomers, every open seat is spoken for
+static int voyageWastedTrips = 0; // Bridge round trips without boarding on the voyage being loaded
+static long long nextLeaseCheckNs = 0; // When reclaimDeadPassengers() looks at the registry again
+
+// Voyage ledger, see ledger.h
+static int ledgerFd = -1;
+static long long dayStartRealNs;
+static long long deniedBeforeVoyage; // live->deniedTotal when loadingVoyage was opened
+static VoyageRecord loadingVoyage; // Voyage being loaded, magic 0 while none is
+static VoyageRecord sailedVoyage; // Last voyage that sailed, appended once its passengers are off
+static int sailedVoyagePending = 0;
+static long long sailedVoyageArrivedNs = 0; // Its arrival in port, 0 while at sea
 
 
 int main(int argc, char *argv[]) {
@@ -25,25 +73,44 @@ int main(int argc, char *argv[]) {
   * Initializes shared memory, message queues, and signal handlers.
   * Enters a loop to perform cruise operations until the end of day.
 */
-    if (argc != 3) {
-        fprintf(stderr, RED "Usage: %s <shmid> <semid>" RESET "\n", argv[0]);
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, RED "Usage: %s <regionFd> <semid> [departurePolicy]" RESET "\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    departurePolicy = selectDeparturePolicy(argc == 4 ? argv[3] : DEPARTURE_POLICY);
+    if (departurePolicy == NULL) {
+        fprintf(stderr, RED "Unknown departure policy \"%s\"." RESET "\n", argv[3]);
         exit(EXIT_FAILURE);
     }
+    dayStartNs = getMonotonicTimeNs();
 
-    shmid = atoi(argv[1]);
+    regionFd = atoi(argv[1]);
     semid = atoi(argv[2]);
 
-    printf(YELLOW "=== Ship Captain ===" RESET " Starting\n");
+    printf(YELLOW "=== Ship Captain ===" RESET " Starting, departure policy: %s\n", departurePolicy->name);
+    traceInit("ship captain", 0);
 
-    sm = attachSharedMemory(shmid);
-    if (sm == (void *)-1) {
-        perror("shmat main");
-        exit(EXIT_FAILURE);
+    sm = attachSharedMemory(regionFd);
+    live = attachSharedSection(SECTION_LIVE_STATS);
+    registry = attachSharedSection(SECTION_REGISTRY);
+    if (sm->requestTransport == REQUEST_TRANSPORT_RING) {
+        requestRing = attachSharedSection(SECTION_REQUEST_RING);
+    }
+    if (sm->passengerEngine) {
+        replyRing = attachSharedSection(SECTION_REPLY_RING);
     }
 
-    sendPID();
     initializeMessageQueue();
+    restoreCheckpoint();
+    dayStartRealNs = getRealTimeNs();
+    ledgerFd = openLedger(LEDGER_PATH);
     setupSignalHandlers();
+    control = openControlServer(CONTROL_SOCKET_PATH);
+    printf(YELLOW "=== Ship Captain ===" RESET " Taking commands on %s.\n", CONTROL_SOCKET_PATH);
+    live->captainPid = getpid(); // Published only once SIGUSR1/SIGUSR2 are handled
+    // Requests can be received and answered from here on, rejs lets passengers arrive
+    reportReady(sm, semid, ROLE_SHIP_CAPTAIN);
 
     while (1) {
         performCruiseOperations();
@@ -83,142 +150,655 @@ void EndOfDayOrEarlyVoyage() {
 
 void handleBridgeQueue() {
 /*
-  * Handles passenger messages and manages the boarding queue.
-  * Processes messages from the message queue to assign sequence numbers
-  * and allow or deny boarding based on ship capacity and queue position.
+  * Handles passenger messages and manages the boarding queues.
+  * Drains the requests that have arrived, then lets the class scheduler allow or deny boarding.
+*/
+
+    processPendingSignals();
+    processControlCommands();
+    reclaimDeadPassengers();
+
+    live->captainLoops++;
+    receiveBridgeRequests(REQUEST_RING_WAIT_US);
+
+    checkAndBoardNextInQueue();
+
+    live->queueDepth = boardingQueueDepth(boarding);
+}
+
+
+int receiveBridgeRequests(long waitUs) {
+/*
+  * Handles the requests that have arrived, over the shared-memory ring in batches or up to 20
+  * at a time from the SysV queue.
+  *
+  * @param waitUs Longest sleep on an empty ring, 0 = do not sleep.
+  * @return Number of requests handled.
 */
+
     BridgeMsg msg;
     int processed = 0;
 
-    while (processed < 20) {
-        ssize_t rcv = msgrcv(msq_id, &msg, sizeof(msg) - sizeof(long), -2, IPC_NOWAIT);
+    if (requestRing != NULL) {
+        if (waitUs > 0 && requestRingWait(requestRing, waitUs)) {
+            live->requestSyscalls++;
+        }
+        while (processed < REQUEST_RING_BATCH && requestRingPop(requestRing, &msg)) {
+            handleBridgeMessage(&msg);
+            processed++;
+        }
+    }
+    while (requestRing == NULL && processed < 20) {
+        live->requestSyscalls++;
+        ssize_t rcv = msgrcv(msq_id, &msg, sizeof(msg) - sizeof(long), -MSG_TAKE_TICKET, IPC_NOWAIT);
         if (rcv == -1) {
-            if (errno == ENOMSG) break;
-            perror(RED "msgrcv handleBridgeQueue" RESET);
+            if (errno != ENOMSG) perror(RED "msgrcv handleBridgeQueue" RESET);
+            break;
         }
+        handleBridgeMessage(&msg);
+        processed++;
+    }
+    return processed;
+}
+
+
+void handleBridgeMessage(const BridgeMsg *msg) {
+/*
+  * Turns one passenger request into an event of the boarding state machine and carries out its actions.
+*/
+
+    BoardingEvent event;
+    event.slot = msg->slot;
+    event.passengerClass = msg->passengerClass;
+    event.sequence = msg->sequence;
+    event.retries = msg->retries;
+    event.gangway = msg->gangway >= 0 && msg->gangway < sm->gangways ? msg->gangway : 0;
+    event.nowNs = getMonotonicTimeNs();
+    if (event.passengerClass < 0 || event.passengerClass >= NUM_PASSENGER_CLASSES) {
+        fprintf(stderr, RED "=== Ship Captain ===" RESET " WARNING: passenger %d has unknown class %d, treated as standard\n", passengerPid(msg->slot), msg->passengerClass);
+        event.passengerClass = CLASS_STANDARD;
+    }
+
+    live->requestsReceived++;
+    live->requestDelayNs += event.nowNs - msg->sentAtNs;
+
+    // Sent by a passenger that died, its place was reclaimed and the slot may have a new owner
+    if (msg->slot >= 0 && msg->slot < REGISTRY_SLOTS && msg->generation != atomic_load(&registry->slots[msg->slot].generation)) {
+        live->staleRequests++;
+        return;
+    }
+
+    BoardingAction action;
+    if (msg->mtype == MSG_ENTER_BRIDGE) {
+        // Passenger entering the bridge and asks for a sequence number within its class
+        event.type = BOARDING_EVENT_ENTER;
+        performBoardingActions(&action, boardingStep(boarding, &event, NULL, &action, 1), 0);
+    } else if (msg->mtype == MSG_WANT_TO_BOARD) {
+        ShipView ship;
+        event.type = BOARDING_EVENT_WANT_TO_BOARD;
+
+        waitSemaphore(semid, SEM_MUTEX);
+        loadShipView(&ship);
+        int count = boardingStep(boarding, &event, &ship, &action, 1);
+        storeShipView(&ship);
+        signalSemaphore(semid, SEM_MUTEX);
+
+        performBoardingActions(&action, count, 0);
+    } else if (msg->mtype == MSG_TAKE_TICKET) {
+        issueTicket(msg);
+    } else {
+        // Other types of messages - i just ignore them
+        fprintf(stderr, RED "=== Ship Captain === Unknown message type=%ld\n" RESET, msg->mtype);
+    }
+}
+
+
+void loadShipView(ShipView *ship) {
+/*
+  * Copies the shared state the boarding state machine works on. Called with SEM_MUTEX held.
+*/
+
+    ship->peopleOnShip = sm->peopleOnShip;
+    ship->peopleOnBridge = sm->peopleOnBridge;
+    ship->peopleToDisembark = sm->peopleToDisembark;
+    if (loadingVoyage.magic != 0 && sm->peopleOnBridge > loadingVoyage.peakBridge) {
+        loadingVoyage.peakBridge = sm->peopleOnBridge;
+    }
+    ship->queueDirection = sm->queueDirection;
+    ship->shipSailing = sm->shipSailing;
+}
 
-       if (msg.mtype == MSG_ENTER_BRIDGE) {
-            // Passenger entering the bridge and asks for a sequence number
-            int seq = globalSequenceCounter++;
-            printf(YELLOW "=== Ship Captain ===" RESET " Passenger %d enters the bridge -> assigned seq=%d\n", msg.pid, seq);
-            
-            // Sending back to the passenger reply
-            BridgeMsg reply;
-            reply.mtype = MSG_SEQUENCE_REPLY;
-            reply.pid = msg.pid;
-            reply.sequence = seq;
-
-            if (msgsnd(msq_id, &reply, sizeof(reply) - sizeof(long), 0) == -1) {
-                perror(RED "msgsnd MSG_SEQUENCE_REPLY" RESET);
-            }
-        } else if (msg.mtype == MSG_WANT_TO_BOARD) {
-            pid_t pid = msg.pid;
-            int seq = msg.sequence;
-            waitSemaphore(semid, SEM_MUTEX);
 
-            // We check if the passenger is the “next in line”
-            // and whether SHIP_CAPACITY has not yet been exceeded.
-            if (seq == nextSequenceToBoard && sm->peopleOnShip < SHIP_CAPACITY) {
-                // Passenger can enter
-                sm->peopleOnShip++;
-                sm->peopleOnBridge--;
-                int currentVoyage = sm->currentVoyage + 1;
-
-                printf(CYAN "=== Passenger %d ===" RESET " Boarded the ship (voyage no. %d). PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", pid, currentVoyage, sm->peopleOnShip, sm->peopleOnBridge);
-                signalSemaphore(semid, SEM_MUTEX); 
-                BridgeMsg ok;
-                ok.mtype = pid;
-                ok.pid = pid;
-                ok.sequence = seq;
-
-                if (msgsnd(msq_id, &ok, sizeof(ok) - sizeof(long), 0) == -1) {
-                    perror("msgsnd MSG_BOARDING_OK immediate");
+void storeShipView(const ShipView *ship) {
+/*
+  * Writes back what the boarding state machine changed. Called with SEM_MUTEX held,
+  * in the same critical section as loadShipView().
+*/
+
+    sm->peopleOnShip = ship->peopleOnShip;
+    sm->peopleOnBridge = ship->peopleOnBridge;
+    sm->queueDirection = ship->queueDirection;
+    sm->shipSailing = ship->shipSailing;
+}
+
+
+void performBoardingActions(const BoardingAction *actions, int count, int currentVoyage) {
+/*
+  * Transport of the boarding state machine: carries its actions out through replyToPassenger(),
+  * replies addressed to the passenger's registry slot so they can't be swapped between classes.
+  *
+  * @param actions Actions returned by boardingStep().
+  * @param count Number of actions.
+  * @param currentVoyage Voyage being loaded, for the boarding log.
+*/
+
+    for (int i = 0; i < count; i++) {
+        const BoardingAction *action = &actions[i];
+        BridgeMsg reply;
+        reply.slot = action->slot;
+        reply.sequence = action->sequence;
+        reply.passengerClass = action->passengerClass;
+        reply.retries = action->retries;
+        reply.gangway = action->gangway;
+
+        switch (action->type) {
+            case BOARDING_ACTION_SEQUENCE:
+                printf(YELLOW "=== Ship Captain ===" RESET " Passenger %d (%s) enters the bridge -> assigned seq=%d\n", passengerPid(action->slot), classNames[action->passengerClass], action->sequence);
+                replyToPassenger(&reply, RED "msgsnd MSG_SEQUENCE_REPLY" RESET);
+                break;
+
+            case BOARDING_ACTION_QUEUED:
+                printf(YELLOW "=== ShipCaptain ===" RESET " Passenger %d queued for boarding (%s, seq=%d)\n", passengerPid(action->slot), classNames[action->passengerClass], action->sequence);
+                break;
+
+            case BOARDING_ACTION_BOARD:
+                if (dockReadyAtNs > 0) {
+                    // First boarding since the ship was ready for the next voyage
+                    long long idleNs = getMonotonicTimeNs() - dockReadyAtNs;
+                    live->lastDockIdleNs = idleNs;
+                    live->dockIdleNs += idleNs;
+                    live->dockIdles++;
+                    dockReadyAtNs = 0;
                 }
+                if (live->firstBoardingNs == 0) {
+                    live->firstBoardingNs = getMonotonicTimeNs();
+                }
+                live->boardedTotal++;
+                live->boardedOnGangway[action->gangway]++;
+                recordBoardingLatency(action->passengerClass, action->latencyNs);
+                recordBoardingRetries(action->retries, action->fromReservation);
+
+                // Send a message to the passenger: "You may board" (MSG_BOARDING_OK)
+                replyToPassenger(&reply, "msgsnd MSG_BOARDING_OK");
+
+                printf(CYAN "=== Passenger %d ===" RESET " Boarded the ship (voyage no. %d, %s). PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", passengerPid(action->slot), currentVoyage, classNames[action->passengerClass], action->peopleOnShip, action->peopleOnBridge);
+                break;
+
+            case BOARDING_ACTION_DENY:
+                denyBoarding(action->slot, action->passengerClass, action->retries);
+                break;
+
+            case BOARDING_ACTION_STALE:
+                // Old seq number, passenger late, shouldnt happen
+                fprintf(stderr, RED "=== Ship Captain ===" RESET " WARNING: passenger %d has old seq=%d\n", passengerPid(action->slot), action->sequence);
+                break;
+
+            case BOARDING_ACTION_OVERFLOW:
+                fprintf(stderr, RED "=== ShipCaptain ===" RESET " ERROR: seq=%d too large.\n", action->sequence);
+                break;
+        }
+    }
+}
+
+
+void replyToPassenger(BridgeMsg *reply, const char *what) {
+/*
+  * Sends a reply addressed to reply->slot: over the message queue to a passenger process,
+  * over the reply ring to a record of the passenger engine. The sequence the passenger
+  * now holds (-1 after a denial) is also recorded in its registry slot.
+  *
+  * @param what Message for perror() if the queue refuses it.
+*/
+
+    reply->mtype = MSG_REPLY_BASE + reply->slot;
+
+    if (replyRing != NULL && reply->slot >= PASSENGER_ENGINE_ID_BASE) {
+        while (!requestRingPush(replyRing, reply)) {
+            usleep(100); // Ring full, the engine drains it in batches
+        }
+        return;
+    }
+
+    if (reply->slot >= 0 && reply->slot < REGISTRY_SLOTS) {
+        atomic_store(&registry->slots[reply->slot].sequence, reply->sequence >= 0 ? reply->sequence : -1);
+    }
+    if (msgsnd(msq_id, reply, sizeof(*reply) - sizeof(long), 0) == -1) {
+        perror(what);
+    }
+}
+
+
+pid_t passengerPid(int slot) {
+    // PID of the passenger holding a registry slot, for the log; engine records show their id
+    return slot >= 0 && slot < REGISTRY_SLOTS ? registry->slots[slot].pid : slot;
+}
+
+
+void recordBoardingLatency(int passengerClass, long long latency) {
+/*
+  * Adds the bridge entry -> boarding latency of a passenger to its class statistics.
+*/
+
+    ClassStats *classStats = &stats.classStats[passengerClass];
+
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && latency >= (1000LL << bucket)) bucket++;
+    live->boardingLatencyBuckets[bucket]++;
+
+    classStats->boarded++;
+    classStats->totalLatencyNs += latency;
+    if (latency > classStats->maxLatencyNs) classStats->maxLatencyNs = latency;
+    if (latency > classStats->voyageMaxLatencyNs) classStats->voyageMaxLatencyNs = latency;
+    if (classLatencySlaMs[passengerClass] > 0 && latency > classLatencySlaMs[passengerClass] * 1000000LL) {
+        classStats->slaMisses++;
+    }
+}
+
+
+void checkAndBoardNextInQueue() {
+/*
+  * Boards the next passengers in the class queues, if conditions allow.
+  * The state machine decides a batch at a time under SEM_MUTEX; the passengers
+  * are told once the mutex is released.
+*/
 
-                nextSequenceToBoard++;
-                checkAndBoardNextInQueue(); 
+    BoardingEvent event = {0};
+    BoardingAction actions[BOARDING_BATCH];
+    ShipView ship;
+    int count;
+
+    event.type = BOARDING_EVENT_SCHEDULE;
+    do {
+        event.nowNs = getMonotonicTimeNs();
+
+        waitSemaphore(semid, SEM_MUTEX);
+        loadShipView(&ship);
+        count = boardingStep(boarding, &event, &ship, actions, BOARDING_BATCH);
+        storeShipView(&ship);
+        int currentVoyage = sm->currentVoyage + 1;
+        int boardedProcesses[MAX_GANGWAYS] = {0};
+        for (int i = 0; i < count; i++) {
+            if (actions[i].type != BOARDING_ACTION_BOARD) {
+                continue;
             }
-            else if (sm->peopleOnShip >= SHIP_CAPACITY) {
-                // Passenger can't enter, ship full
-                sm->shipSailing = 1;
-                sm->queueDirection = 1;
-                signalSemaphore(semid, SEM_MUTEX);
-
-                BridgeMsg den;
-                den.mtype = pid; 
-                den.pid = pid;
-                den.sequence = -1; // denied
-
-                if (msgsnd(msq_id, &den, sizeof(den) - sizeof(long), 0) == -1) {
-                    perror("msgsnd MSG_BOARDING_DENIED");
-                }
+            sm->peopleOnGangway[actions[i].gangway]--;
+            // Registered on the ship and off the bridge in the critical section that counts them there
+            if (actions[i].slot < REGISTRY_SLOTS) {
+                registry->slots[actions[i].slot].voyage = sm->currentVoyage;
+                registrySetState(registry, actions[i].slot, REGISTRY_ON_SHIP);
+                boardedProcesses[actions[i].gangway]++;
             }
-            else if (seq < nextSequenceToBoard) {
-                // Old seq number, passenger late, shouldnt happen
-                signalSemaphore(semid, SEM_MUTEX);
-                fprintf(stderr, RED "=== Ship Captain ===" RESET " WARNING: passenger %d has old seq=%d\n", pid, seq);
+        }
+        for (int g = 0; g < sm->gangways; g++) {
+            if (boardedProcesses[g] > 0) {
+                returnTokens(semid, SEM_GANGWAY(g), boardedProcesses[g]);
             }
-            else {
-                // seq > nextSequenceToBoard => passenger queued
-                if (seq >= MAX_WAITING) {
-                    signalSemaphore(semid, SEM_MUTEX);
-                    fprintf(stderr, RED "=== ShipCaptain ===" RESET " ERROR: seq=%d too large.\n", seq);
-                } else {
-                    waitingArray[seq] = pid;
-                    printf(YELLOW "=== ShipCaptain ===" RESET " Passenger %d queued for boarding (seq=%d)\n", pid, seq);
-                    signalSemaphore(semid, SEM_MUTEX);
+        }
+        signalSemaphore(semid, SEM_MUTEX);
+
+        performBoardingActions(actions, count, currentVoyage);
+    } while (count == BOARDING_BATCH);
+}
+
+
+void recordBoardingRetries(int retries, int fromReservation) {
+/*
+  * Adds the number of times a boarded passenger had been turned away to the retry statistics.
+*/
+
+    stats.boardedTotal++;
+    stats.retriesTotal += retries;
+    if (retries > stats.worstRetries) stats.worstRetries = retries;
+    if (fromReservation) stats.boardedFromReservation++;
+}
+
+
+void denyBoarding(int slot, int passengerClass, int retries) {
+/*
+  * Denies boarding on this voyage. If there is room in the carry-over queue,
+  * the passenger keeps a reservation and will be called first on the next voyage.
+  *
+  * @param slot Registry slot of the denied passenger.
+  * @param passengerClass The boarding class of the passenger.
+  * @param retries How many times the passenger was turned away before.
+*/
+
+    BridgeMsg den;
+    den.slot = slot;
+    den.sequence = SEQ_DENIED;
+    den.passengerClass = passengerClass;
+    den.retries = retries + 1;
+    live->deniedTotal++;
+    if (live->phase == PHASE_LOADING || live->phase == PHASE_RESERVED_BOARDING) {
+        voyageWastedTrips++; // Those still on the bridge at departure are counted in startCruisePreparation()
+    }
+
+    if (carryOverCount < MAX_WAITING) {
+        Reservation *r = &carryOver[(carryOverHead + carryOverCount) % MAX_WAITING];
+        r->slot = slot;
+        r->passengerClass = passengerClass;
+        r->retries = retries + 1;
+        carryOverCount++;
+        live->reservationsWaiting = carryOverCount;
+        den.sequence = SEQ_DENIED_RESERVED;
+    }
+
+    replyToPassenger(&den, "msgsnd MSG_BOARDING_DENIED");
+}
+
+
+void issueTicket(const BridgeMsg *msg) {
+/*
+  * Pre-ticketing: a passenger who found the ship away or disembarking is put in line for the
+  * next voyage, behind the passengers denied with a reservation, instead of bouncing off the
+  * bridge until it opens. Ticket holders are called in order by boardReservedPassengers() before
+  * the bridge opens to everyone, so loading starts with a full bridge. Refused (SEQ_DENIED) once
+  * the bridge is open again, at the end of the day or when the carry-over queue is full; the passenger then just tries the bridge.
+*/
+
+    BridgeMsg reply;
+    reply.slot = msg->slot;
+    reply.sequence = SEQ_DENIED;
+    reply.passengerClass = msg->passengerClass;
+    reply.retries = msg->retries;
+
+    waitSemaphore(semid, SEM_MUTEX);
+    int shipAway = (sm->queueDirection == 1 || sm->shipSailing == 1) && !sm->signalEndOfDay;
+    signalSemaphore(semid, SEM_MUTEX);
+
+    if (shipAway && carryOverCount < MAX_WAITING && msg->slot < REGISTRY_SLOTS) {
+        Reservation *r = &carryOver[(carryOverHead + carryOverCount) % MAX_WAITING];
+        r->slot = msg->slot;
+        r->passengerClass = msg->passengerClass;
+        r->retries = msg->retries;
+        carryOverCount++;
+        live->reservationsWaiting = carryOverCount;
+        live->ticketsIssued++;
+
+        // Registered before the reply, so a ticket holder that dies is found holding its place in line
+        registrySetState(registry, msg->slot, REGISTRY_RESERVATION);
+        reply.sequence = SEQ_TICKETED;
+        printf(YELLOW "=== Ship Captain ===" RESET " Passenger %d (%s) takes ticket %d for the next voyage.\n", passengerPid(msg->slot), classNames[msg->passengerClass], carryOverCount);
+    }
+
+    replyToPassenger(&reply, "msgsnd ticket");
+}
+
+
+void boardReservedPassengers() {
+/*
+  * Calls passengers holding carry-over reservations before the bridge opens for everyone else.
+  * Each called passenger gets the next sequence of its class, so they board first and
+  * never compete for the bridge with newcomers. Only as many passengers as can be seated
+  * are called; the rest keep their place in the carry-over queue. At most BRIDGE_CAPACITY
+  * called passengers are outstanding at a time, so the next one in order always finds room on the bridge.
+*/
+
+    int tentative[NUM_PASSENGER_CLASSES] = {0};
+    int seated = 0, called = 0, outstanding = 0;
+
+    if (carryOverCount == 0) {
+        return;
+    }
+
+    live->phase = PHASE_RESERVED_BOARDING;
+    waitSemaphore(semid, SEM_MUTEX);
+    sm->queueDirection = 2; // towards ship, but only for called passengers
+    signalSemaphore(semid, SEM_MUTEX);
+
+    while (1) {
+        while (carryOverCount > 0 && seated < SHIP_CAPACITY && outstanding < BRIDGE_CAPACITY) {
+            Reservation *r = &carryOver[carryOverHead];
+
+            // Seats reserved for other classes still have to stay free
+            int held = 0;
+            for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+                if (c != r->passengerClass && tentative[c] < classReservedSeats[c]) {
+                    held += classReservedSeats[c] - tentative[c];
                 }
             }
-        } else {
-            // Other types of messages - i just ignore them
-            fprintf(stderr, RED "=== Ship Captain === Unknown message type=%ld\n" RESET, msg.mtype);
+            if (SHIP_CAPACITY - seated - held <= 0) {
+                break;
+            }
+
+            // Spread over the gangways in call order; with at most BRIDGE_CAPACITY called at a time none overfills
+            int gangway = called % sm->gangways;
+            int seq = boardingCallReserved(boarding, r->passengerClass, gangway, getMonotonicTimeNs());
+
+            BridgeMsg call;
+            call.slot = r->slot;
+            call.sequence = seq;
+            call.passengerClass = r->passengerClass;
+            call.retries = r->retries;
+            call.gangway = gangway;
+            if (r->slot < REGISTRY_SLOTS) {
+                registry->slots[r->slot].gangway = gangway; // For boardingAbandon() if it dies before crossing
+            }
+
+            replyToPassenger(&call, "msgsnd reservation call");
+
+            tentative[r->passengerClass]++;
+            seated++;
+            called++;
+            outstanding++;
+            carryOverHead = (carryOverHead + 1) % MAX_WAITING;
+            carryOverCount--;
+            live->reservationsWaiting = carryOverCount;
+        }
+
+        if (outstanding == 0) {
+            break;
+        }
+
+        handleBridgeQueue();
+
+        // Called passengers that have not boarded (or been denied again) yet
+        outstanding = boardingReservedOutstanding(boarding);
+
+        waitSemaphore(semid, SEM_MUTEX);
+        int endOfDay = sm->signalEndOfDay;
+        signalSemaphore(semid, SEM_MUTEX);
+
+        if (endOfDay) {
+            break;
         }
-        processed++;
+    }
+
+    if (called > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Boarded %d passengers with reservations first, %d reservations left for later voyages.\n", called, carryOverCount);
     }
 }
 
 
-void checkAndBoardNextInQueue() {
+void dismissReservations() {
 /*
-  * Boards the next passenger in the queue, if conditions allow.
-  * Checks the queue for passengers ready to board and processes them.
+  * Sends the passengers still holding a reservation or a ticket home at the end of the day.
+  * They sleep on their reply until they are called, so they would not notice the day ending.
+  * Passenger engine records watch the end of the day themselves.
 */
 
-    while (nextSequenceToBoard < MAX_WAITING && waitingArray[nextSequenceToBoard] != 0) {
-        pid_t pid = waitingArray[nextSequenceToBoard];
-        waitingArray[nextSequenceToBoard] = 0;
+    for (int i = 0; i < carryOverCount; i++) {
+        Reservation *r = &carryOver[(carryOverHead + i) % MAX_WAITING];
+        if (r->slot >= REGISTRY_SLOTS) continue;
 
-        if (nextSequenceToBoard < SHIP_CAPACITY) {
-            // Send a message to the passenger: "You may board" (MSG_BOARDING_OK)
-            BridgeMsg ok;
-            ok.mtype = pid;
-            ok.pid = pid;
-            ok.sequence = nextSequenceToBoard; // informational
+        BridgeMsg dismissal;
+        dismissal.slot = r->slot;
+        dismissal.sequence = SEQ_DENIED;
+        dismissal.passengerClass = r->passengerClass;
+        dismissal.retries = r->retries;
+        replyToPassenger(&dismissal, "msgsnd dismissal");
+    }
+    carryOverCount = 0;
+    live->reservationsWaiting = 0;
+}
 
-            if (msgsnd(msq_id, &ok, sizeof(ok) - sizeof(long), 0) == -1) {
-                perror("msgsnd MSG_BOARDING_OK");
-            }
 
-            waitSemaphore(semid, SEM_MUTEX);
-            int newShipCount = ++(sm->peopleOnShip);
-            int newBridgeCount = --(sm->peopleOnBridge); 
-            int currentVoyage = sm->currentVoyage + 1;
-            signalSemaphore(semid, SEM_MUTEX);
+void reclaimDeadPassengers() {
+/*
+  * Lease check: at most every LEASE_CHECK_MS, looks for registered passengers whose process
+  * is gone and takes back what they held. SEM_MUTEX comes back by itself through SEM_UNDO;
+  * their place is taken back here, going by the registry state written together with each
+  * count: one off the bridge (and its token), the ship or the lane towards land (and its token).
+  * A sequence the passenger held is passed over, a carry-over reservation dropped.
+  * Without this, a passenger killed on the bridge would keep startCruisePreparation() and
+  * waitForAllPassengersToDisembark() waiting forever.
+*/
 
-            printf(CYAN "=== Passenger %d ===" RESET " Boarded the ship (voyage no. %d). PEOPLE ON SHIP: %d, PEOPLE ON BRIDGE: %d\n", pid, currentVoyage, newShipCount, newBridgeCount);
+    long long nowNs = getMonotonicTimeNs();
+    if (nowNs < nextLeaseCheckNs) {
+        return;
+    }
+    nextLeaseCheckNs = nowNs + LEASE_CHECK_MS * 1000000LL;
 
-            nextSequenceToBoard++;
-        } else {
-            BridgeMsg den;
-            den.mtype = pid; 
-            den.pid = pid;
-            den.sequence = -1; // denied
+    for (int slot = 0; slot < REGISTRY_SLOTS; slot++) {
+        RegistrySlot *entry = &registry->slots[slot];
+        if (atomic_load_explicit(&entry->state, memory_order_relaxed) == REGISTRY_FREE) {
+            continue;
+        }
+        int generation = atomic_load(&entry->generation);
+        pid_t pid = entry->pid;
+        if (kill(pid, 0) == 0 || errno != ESRCH) {
+            continue;
+        }
 
-            if (msgsnd(msq_id, &den, sizeof(den) - sizeof(long), 0) == -1) {
-                perror("msgsnd MSG_BOARDING_DENIED");
+        // The passenger may have left normally between the checks and a new one taken the slot:
+        // only a slot still held by the same dead owner is reclaimed, nobody else changes that one
+        waitSemaphore(semid, SEM_MUTEX);
+        int state = atomic_load(&entry->state);
+        if (state == REGISTRY_FREE || atomic_load(&entry->generation) != generation || entry->pid != pid) {
+            signalSemaphore(semid, SEM_MUTEX);
+            continue;
+        }
+        int sequence = atomic_load(&entry->sequence);
+        int gangway = entry->gangway;
+        if (state == REGISTRY_ON_BRIDGE) {
+            sm->peopleOnBridge--;
+            sm->peopleOnGangway[gangway]--;
+            returnTokens(semid, SEM_GANGWAY(gangway), 1);
+        } else if (state == REGISTRY_ON_SHIP) {
+            sm->peopleOnShip--;
+            if (sm->currentVoyage > entry->voyage && sm->peopleToDisembark > 0) {
+                sm->peopleToDisembark--;
             }
+        } else if (state == REGISTRY_LEAVING) {
+            if (sm->twoLaneBridge) sm->peopleOnBridgeInbound--;
+            else sm->peopleOnBridge--;
+            returnTokens(semid, sm->twoLaneBridge ? SEM_BRIDGE_INBOUND : SEM_BRIDGE, 1);
+        }
+        signalSemaphore(semid, SEM_MUTEX);
 
-            nextSequenceToBoard++;
+        if ((state == REGISTRY_ON_BRIDGE || state == REGISTRY_RESERVATION) && sequence >= 0) {
+            boardingAbandon(boarding, entry->passengerClass, gangway, sequence);
+        }
+        dropReservations(slot);
+
+        printf(YELLOW "=== Ship Captain ===" RESET " Passenger %d died (%s), reclaimed its place.\n", pid, registryStateNames[state]);
+        registryRelease(registry, slot);
+        live->passengersReclaimed++;
+    }
+}
+
+
+void dropReservations(int slot) {
+/*
+  * Removes a reclaimed passenger's reservations from the carry-over queue, keeping the order of the others.
+*/
+
+    int kept = 0;
+    for (int i = 0; i < carryOverCount; i++) {
+        Reservation *r = &carryOver[(carryOverHead + i) % MAX_WAITING];
+        if (r->slot != slot) {
+            carryOver[(carryOverHead + kept++) % MAX_WAITING] = *r;
+        }
+    }
+    carryOverCount = kept;
+    live->reservationsWaiting = carryOverCount;
+}
+
+
+void restoreCheckpoint() {
+/*
+  * Maps the checkpoint file and, on a warm restart, restores the statistics of the day
+  * saved at the end of the voyage the shared state continues from.
+*/
+
+    waitSemaphore(semid, SEM_MUTEX);
+    int currentVoyage = sm->currentVoyage;
+    signalSemaphore(semid, SEM_MUTEX);
+
+    long long start = getMonotonicTimeNs();
+    checkpoint = openCheckpoint(CHECKPOINT_PATH);
+
+    CheckpointState state;
+    if (currentVoyage > 0 && loadCheckpoint(checkpoint, &state) && state.shared.currentVoyage == currentVoyage) {
+        stats = state.captain;
+        printf(YELLOW "=== Ship Captain ===" RESET " Continuing after voyage %d, statistics restored in %.3f ms.\n", currentVoyage, (getMonotonicTimeNs() - start) / 1e6);
+    }
+}
+
+
+void saveCheckpoint() {
+/*
+  * Checkpoints the shared state and the statistics of the day at a voyage boundary.
+  * Reservations are not part of it, their passenger processes do not survive a restart.
+*/
+
+    CheckpointState state;
+
+    waitSemaphore(semid, SEM_MUTEX);
+    state.shared = *sm;
+    signalSemaphore(semid, SEM_MUTEX);
+    state.captain = stats;
+
+    long long start = getMonotonicTimeNs();
+
+    writeCheckpoint(checkpoint, &state);
+    printf(YELLOW "=== Ship Captain ===" RESET " Checkpoint after voyage %d written in %.3f ms.\n", state.shared.currentVoyage, (getMonotonicTimeNs() - start) / 1e6);
+}
+
+
+void closeVoyageClassStats() {
+/*
+  * Closes per-voyage class statistics: notes which classes missed their SLA during the voyage.
+*/
+
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        ClassStats *classStats = &stats.classStats[c];
+        if (classLatencySlaMs[c] > 0 && classStats->voyageMaxLatencyNs > classLatencySlaMs[c] * 1000000LL) {
+            classStats->voyagesMissingSla++;
+        }
+        classStats->voyageMaxLatencyNs = 0;
+    }
+}
+
+
+void printClassStats() {
+/*
+  * Prints boarding latency statistics per class and whether each class kept its SLA.
+*/
+
+    printf(YELLOW "=== Ship Captain ===" RESET " Retries per boarded passenger: mean %.2f, worst case %d (%lld of %lld boarded on a reservation, %d reservations unused).\n",
+           stats.boardedTotal ? (double)stats.retriesTotal / stats.boardedTotal : 0.0, stats.worstRetries, stats.boardedFromReservation, stats.boardedTotal, carryOverCount);
+    printf(YELLOW "=== Ship Captain ===" RESET " Boarding latency per class (bridge entry -> boarding):\n");
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        ClassStats *classStats = &stats.classStats[c];
+        double meanMs = classStats->boarded ? classStats->totalLatencyNs / 1e6 / classStats->boarded : 0.0;
+
+        printf(YELLOW "=== Ship Captain ===" RESET "   %-16s boarded %lld, mean %.2f ms, max %.2f ms", classNames[c], classStats->boarded, meanMs, classStats->maxLatencyNs / 1e6);
+        if (classLatencySlaMs[c] > 0) {
+            printf(", SLA %d ms: %s (%lld late passengers, %d voyages missed)\n", classLatencySlaMs[c], classStats->voyagesMissingSla ? "MISSED" : "held", classStats->slaMisses, classStats->voyagesMissingSla);
+        } else {
+            printf(", no SLA\n");
         }
     }
 }
@@ -229,95 +809,229 @@ void performCruiseOperations() {
   * Performs the main operations of a cruise.
   * Handles passenger boarding, cruise execution, disembarkation, and preparation for the next cruise.
 */
-    struct timeval start, current;
-    long long elapsedSeconds = 0;
+    LoadingProgress progress = {0};
+    long long boardedBefore = live->boardedTotal;
 
+    if (loadingVoyage.magic == 0) {
+        openVoyageRecord(); // Not opened by reserved boarding
+    }
+    loadingVoyage.departureReason = DEPARTURE_REASON_TIMER;
     loaded = 0;
-    // Timer to allow proper loading
-    gettimeofday(&start, NULL); 
-    while (elapsedSeconds < TIME_BETWEEN_TRIPS) {
+    live->phase = PHASE_LOADING;
+    traceBegin("loading");
+    // The departure policy decides when loading ends, unless SIGUSR1 comes first
+    long long start = getMonotonicTimeNs();
+    departurePolicy->startWindow(departurePolicy);
+    while (1) {
         handleBridgeQueue();
 
         if(signalReceived) {
             signalReceived = 0;
+            loadingVoyage.departureReason = DEPARTURE_REASON_SIGNAL;
+            break;
+        }
+
+        waitSemaphore(semid, SEM_MUTEX);
+        progress.peopleOnShip = sm->peopleOnShip;
+        progress.openSeats = boardingSeatsForClass(boarding, CLASS_STANDARD, progress.peopleOnShip);
+        int allSeatsTaken = updateBridgeAdmission(progress.openSeats);
+        int peopleToDisembark = sm->peopleToDisembark;
+        signalSemaphore(semid, SEM_MUTEX);
+
+        if (peopleToDisembark == 0) {
+            closeSailedVoyage(); // Two-lane bridge: the last voyage's passengers are off
+        }
+        if (allSeatsTaken) {
+            printf(YELLOW "=== Ship Captain ===" RESET " Every open seat is taken and the bridge is empty, departing now.\n");
+            loadingVoyage.departureReason = DEPARTURE_REASON_FULL;
+            break;
+        }
+
+        progress.elapsedNs = getMonotonicTimeNs() - start;
+        progress.boardedInWindow = live->boardedTotal - boardedBefore;
+
+        if (departurePolicy->shouldDepart(departurePolicy, &progress)) {
             break;
         }
-        
-        gettimeofday(&current, NULL);
-        elapsedSeconds = current.tv_sec - start.tv_sec; // diff in seconds
     }
     loaded = 1;
 
+    long long loadingWindowNs = getMonotonicTimeNs() - start;
+    live->lastLoadingWindowNs = loadingWindowNs;
+    live->loadingWindowsNs += loadingWindowNs;
+    live->loadingWindows++;
+    loadingVoyage.loadingNs = loadingWindowNs;
+    traceEnd();
 
+    traceBegin("preparation");
     startCruisePreparation();
+    traceEnd();
+
+    traceBegin("voyage");
     performVoyage();
+    traceEnd();
+
+    traceBegin("disembark");
     performDisembarkation();
+    traceEnd();
+
     getReadyForNextCruise();
 }
 
 
+int updateBridgeAdmission(int openSeats) {
+/*
+  * Closes the bridge to newcomers once the passengers already on it can take every seat
+  * still open, so nobody walks onto the bridge only to be turned back, and reopens it if
+  * some of them are denied after all. Called while loading, with SEM_MUTEX held.
+  *
+  * @param openSeats Seats any class may still take.
+  * @return 1 once admission is closed, the bridge is empty and no open seat is left.
+*/
+
+#if BRIDGE_EARLY_CLOSURE
+    if (sm->queueDirection == 0 && sm->peopleOnBridge >= openSeats) {
+        sm->queueDirection = 2; // Towards ship, for those already on the bridge only
+        setBoardingGate(semid, 0);
+        admissionClosedEarly = 1;
+    } else if (admissionClosedEarly && sm->peopleOnBridge < openSeats) {
+        sm->queueDirection = 0;
+        setBoardingGate(semid, 1);
+        admissionClosedEarly = 0;
+    }
+    return admissionClosedEarly && sm->peopleOnBridge == 0 && openSeats <= 0;
+#else
+    (void)openSeats;
+    return 0;
+#endif
+}
+
+
 void startCruisePreparation() {
 /*
   * Prepares for a cruise.
   * Ensures all passengers on the bridge leave and sets the ship's status to sailing.
 */
+    live->phase = PHASE_PREPARATION;
+    long long preparationStartNs = getMonotonicTimeNs();
     printf(YELLOW "=== Ship Captain ===" RESET " All the people on the bridge have to go ashore, we are sailing away!\n");
 
+    // On a two-lane bridge the last voyage's passengers may still be leaving, the ship
+    // is marked as sailing only once they are off and both lanes are empty
     waitSemaphore(semid, SEM_MUTEX);
+    int twoLaneBridge = sm->twoLaneBridge;
+    voyageWastedTrips += sm->peopleOnBridge; // All of them walk back
     sm->queueDirection = 1;
-    sm->shipSailing = 1;
+    sm->shipSailing = !twoLaneBridge;
     signalSemaphore(semid, SEM_MUTEX);
-
-    dumpPassengersFromWaitingArray();
+    setBoardingGate(semid, 0); // Newcomers sleep until getReadyForNextCruise()
+    admissionClosedEarly = 0;
 
     // Waiting for all passengers to get off the bridge
     while (1) { 
         handleBridgeQueue(); // clear message queue
+        // Requests still arriving may sit behind a sequence whose passenger already turned back
+        dumpPassengersFromWaitingArray();
 
         waitSemaphore(semid, SEM_MUTEX);
-        int peopleOnBridge = sm->peopleOnBridge;
+        int bridgeEmpty = sm->peopleOnBridge == 0 && sm->peopleOnBridgeInbound == 0 && sm->peopleToDisembark == 0;
+        if (bridgeEmpty) {
+            sm->shipSailing = 1;
+        }
         signalSemaphore(semid, SEM_MUTEX);
-        if (peopleOnBridge == 0) {
+        if (bridgeEmpty) {
+            closeSailedVoyage();
             break;
         }
     }
 
+    if (arrivedAtNs > 0) {
+        long long turnaroundNs = getMonotonicTimeNs() - arrivedAtNs;
+        live->lastTurnaroundNs = turnaroundNs;
+        live->turnaroundsNs += turnaroundNs;
+        live->turnarounds++;
+    }
+
     waitSemaphore(semid, SEM_MUTEX);
     int voyageNumber = sm->currentVoyage + 1;
     int peopleOnVoyage = sm->peopleOnShip;
     signalSemaphore(semid, SEM_MUTEX);
 
     printf(YELLOW "=== Ship Captain ===" RESET " All passengers have descended. We sail away.\n");
+    printf(YELLOW "=== Ship Captain ===" RESET " Wasted bridge round trips while loading: %d\n", voyageWastedTrips);
+    live->wastedBridgeTrips += voyageWastedTrips;
+
+    // The voyage is on its way to the ledger, it is written once its passengers are off
+    loadingVoyage.voyage = voyageNumber;
+    loadingVoyage.preparationNs = getMonotonicTimeNs() - preparationStartNs;
+    loadingVoyage.passengers = peopleOnVoyage;
+    loadingVoyage.denials = live->deniedTotal - deniedBeforeVoyage;
+    loadingVoyage.wastedTrips = voyageWastedTrips;
+    sailedVoyage = loadingVoyage;
+    sailedVoyagePending = 1;
+    sailedVoyageArrivedNs = 0;
+    loadingVoyage.magic = 0;
+
+    voyageWastedTrips = 0;
     printf(YELLOW "=== Ship Captain ===" RESET " Sailing on cruise %d with %d passengers.\n", voyageNumber, peopleOnVoyage);
 }
 
 
+void openVoyageRecord() {
+/*
+  * Starts the ledger record of the next voyage, when its loading begins (reserved boarding included).
+*/
+
+    memset(&loadingVoyage, 0, sizeof(loadingVoyage));
+    loadingVoyage.magic = LEDGER_RECORD_MAGIC;
+    loadingVoyage.dayStartNs = dayStartRealNs;
+    loadingVoyage.startNs = getRealTimeNs();
+    loadingVoyage.shipCapacity = SHIP_CAPACITY;
+    snprintf(loadingVoyage.departurePolicy, sizeof(loadingVoyage.departurePolicy), "%s", departurePolicy->name);
+    deniedBeforeVoyage = live->deniedTotal;
+}
+
+
+void closeSailedVoyage() {
+/*
+  * Appends the last voyage that sailed to the ledger once all its passengers are off,
+  * or at the end of the day if it ends at sea.
+*/
+
+    if (!sailedVoyagePending) {
+        return;
+    }
+    sailedVoyage.endNs = getRealTimeNs();
+    sailedVoyage.disembarkNs = sailedVoyageArrivedNs > 0 ? getMonotonicTimeNs() - sailedVoyageArrivedNs : 0;
+    appendLedgerRecord(ledgerFd, &sailedVoyage);
+    sailedVoyagePending = 0;
+}
+
+
 void performVoyage() {
 /*
   * Simulates a voyage.
-  * Uses nanosleep to simulate the duration of the voyage, handling interruptions.
+  * Sleeps for the duration of the voyage, waking up only for control commands.
 */
 
     waitSemaphore(semid, SEM_MUTEX);
     int voyageNumber = sm->currentVoyage + 1;
     signalSemaphore(semid, SEM_MUTEX);
 
+    live->phase = PHASE_VOYAGE;
     printf(YELLOW "=== Ship Captain ===" RESET " Starting voyage %d. TRIP DURATION: %ds\n", voyageNumber, TRIP_DURATION);
 
-    //Simulation of cruise
-    struct timespec req, rem;
-    req.tv_sec = TRIP_DURATION;
-    req.tv_nsec = 0;
-
-    // Loop to ensure the full trip duration is completed
-    while (nanosleep(&req, &rem) == -1) {
-        if (errno == EINTR) {
+    // Simulation of cruise, still answering the control socket; signals wait for the arrival
+    long long voyageEndNs = getMonotonicTimeNs() + TRIP_DURATION * 1000000000LL;
+    long long now;
+    while ((now = getMonotonicTimeNs()) < voyageEndNs) {
+        long long sleepNs = voyageEndNs - now < LEASE_CHECK_MS * 1000000LL ? voyageEndNs - now : LEASE_CHECK_MS * 1000000LL;
+        if (waitControlServer(control, sleepNs) == -1 && errno == EINTR) {
             printf(YELLOW "=== Ship Captain ===" RESET " Signal received during voyage, resuming sleep...\n");
-            req = rem; // Use remaining time to continue sleeping
-        } else {
-            perror(RED "nanosleep" RESET);
-            exit(EXIT_FAILURE);
         }
+        processControlCommands();
+        reclaimDeadPassengers();
+        receiveBridgeRequests(0); // Tickets for the next voyage, nobody else can be asking
     }
 }
 
@@ -328,6 +1042,8 @@ void performDisembarkation() {
   * Manages end-of-day signal that appeared during cruise and ensures all passengers leave the ship.
 */
 
+    processPendingSignals();
+
     // End-of-day received during cruise, disembark all passengers and end
     if (endOfDaySignal) {
         printf(YELLOW "=== Ship Captain ===" RESET " End-of-day signal received during voyage. Ending day as per signal.\n");
@@ -343,17 +1059,27 @@ void performDisembarkation() {
     waitSemaphore(semid, SEM_MUTEX);
     sm->shipSailing = 0; // end of cruise
     sm->queueDirection = 1; // towards land to disembark
+    sm->peopleToDisembark = sm->peopleOnShip;
     int voyageNumber = ++(sm->currentVoyage);
+    int twoLaneBridge = sm->twoLaneBridge;
     signalSemaphore(semid, SEM_MUTEX);
+    arrivedAtNs = getMonotonicTimeNs();
+    sailedVoyageArrivedNs = arrivedAtNs;
+    live->voyagesCompleted++;
+    updateSchedulingStats();
 
+    live->phase = PHASE_DISEMBARK;
     printf(YELLOW "=== Ship Captain ===" RESET " Cruise %d has ended. Arriving at port.\n", voyageNumber);
 
-    // Reset waiting queue
-    memset(waitingArray, 0, sizeof(waitingArray));
-    globalSequenceCounter = 0;
-    nextSequenceToBoard = 0;
+    // Reset waiting queues
+    closeVoyageClassStats();
+    resetBoardingState(boarding);
 
-    waitForAllPassengersToDisembark();
+    // With two lanes, boarding for the next voyage starts while passengers are still leaving
+    if (!twoLaneBridge || voyageNumber >= NUMBER_OF_TRIPS_PER_DAY) {
+        waitForAllPassengersToDisembark();
+        closeSailedVoyage();
+    }
 }
 
 void getReadyForNextCruise() {
@@ -376,10 +1102,20 @@ void getReadyForNextCruise() {
         cleanupAndExit();
     }
 
+    saveCheckpoint();
+    dockReadyAtNs = getMonotonicTimeNs();
+
+    // Passengers denied last time or ticketed ashore board first, before the bridge opens for everyone
+    openVoyageRecord();
+    traceBegin("reserved boarding");
+    boardReservedPassengers();
+    traceEnd();
+
     // Change bridge direction again
     waitSemaphore(semid, SEM_MUTEX);
     sm->queueDirection = 0; // towards ship, getting ready for next voyage
     signalSemaphore(semid, SEM_MUTEX);
+    setBoardingGate(semid, 1); // Wakes the passengers that arrived while boarding was closed
 
     printf(YELLOW "=== Ship Captain ===" RESET " Bridge direction set back to boarding for the next voyage.\n");
 }
@@ -394,7 +1130,7 @@ void waitForAllPassengersToDisembark() {
         handleBridgeQueue(); // clear message queue
         waitSemaphore(semid, SEM_MUTEX);
         int peopleOnShip = sm->peopleOnShip;
-        int peopleOnBridge = sm->peopleOnBridge;
+        int peopleOnBridge = sm->peopleOnBridge + sm->peopleOnBridgeInbound;
         signalSemaphore(semid, SEM_MUTEX);
 
         dumpPassengersFromWaitingArray();
@@ -407,81 +1143,162 @@ void waitForAllPassengersToDisembark() {
 }
 
 
-void sendPID() {
-// Sends the ship captain's PID to the harbour captain via FIFO.
+void initializeMessageQueue() {
+// Initializes the message queue for bridge communication.
 
-    int fifo_fd = open(FIFO_PATH, O_WRONLY);
-    if (fifo_fd == -1) {
-        perror("open fifo");
+    msq_id = msgget(BRIDGE_QUEUE_KEY, IPC_CREAT | MSG_PERMISSIONS);
+    if (msq_id == -1) {
+        perror(RED "msgget shipCaptain" RESET);
         exit(EXIT_FAILURE);
     }
 
-    pid_t myPID = getpid();
-
-    // Writing PID to FIFO
-    if (write(fifo_fd, &myPID, sizeof(myPID)) == -1) {
-        perror(RED "write to FIFO" RESET);
+    boarding = createBoardingState(MAX_WAITING, SHIP_CAPACITY, sm->gangwayOrder == GANGWAY_ORDER_GANGWAY ? sm->gangways : 1);
+    if (boarding == NULL) {
+        perror(RED "createBoardingState" RESET);
         exit(EXIT_FAILURE);
     }
-
-    printf(YELLOW "=== Ship Captain ===" RESET " PID was sent to the harbour captain.\n");
-    close(fifo_fd); // Closing FIFO
 }
 
 
-void initializeMessageQueue() {
-// Initializes the message queue for bridge communication.
+void handle_signal(int sig) {
+/*
+  * Records signals for early voyage (SIGUSR1) or end of day (SIGUSR2).
+  * They are acted on by processPendingSignals() from the captain's loops, never inside
+  * the handler, which could interrupt the captain while it holds SEM_MUTEX.
+*/
 
-    msq_id = msgget(BRIDGE_QUEUE_KEY, IPC_CREAT | MSG_PERMISSIONS);
-    if (msq_id == -1) {
-        perror(RED "msgget shipCaptain" RESET);
-        exit(EXIT_FAILURE);
+    if (sig == SIGUSR1) {
+        pendingEarlyVoyage = 1;
+    } else if (sig == SIGUSR2) {
+        pendingEndOfDay = 1;
     }
-    memset(waitingArray, 0, sizeof(waitingArray));
 }
 
 
-void handle_signal(int sig) {
+void processPendingSignals() {
 /*
-  * Handles signals for early voyage (SIGUSR1) or end of day (SIGUSR2).
+  * Handles signals recorded by handle_signal().
   * Modifies ship status or queue direction based on the signal received.
 */
 
-    if (sig == SIGUSR1) {
-        waitSemaphore(semid, SEM_MUTEX);
-        if (sm->shipSailing == 1) {
-            printf(YELLOW "=== Ship Captain ===" RESET " I'm currently sailing, the signal cannot be made.\n");
-            signalSemaphore(semid, SEM_MUTEX);
-        } else if (sm->shipSailing == 0 && sm->queueDirection == 0) {
-            earlyVoyage = 1;
-            sm->queueDirection = 1;
-            sm->shipSailing = 1;
-            signalSemaphore(semid, SEM_MUTEX);
-        } else {
-            sm->queueDirection = 1;
-            sm->shipSailing = 1;
-            signalSemaphore(semid, SEM_MUTEX);
-            waitForAllPassengersToDisembark();
-            earlyVoyage = 1;
+    if (pendingEarlyVoyage) {
+        pendingEarlyVoyage = 0;
+        startEarlyDeparture();
+        EndOfDayOrEarlyVoyage();
+    }
+
+    if (pendingEndOfDay) {
+        pendingEndOfDay = 0;
+        startEndOfDay();
+        EndOfDayOrEarlyVoyage();
+    }
+}
+
+
+int startEarlyDeparture() {
+/*
+  * Closes the loading window early, on SIGUSR1 or the "depart" command.
+  *
+  * @return 0 if the ship is sailing and the request is refused, 1 otherwise.
+*/
+
+    live->earlyDepartures++;
+
+    waitSemaphore(semid, SEM_MUTEX);
+    if (sm->shipSailing == 1) {
+        printf(YELLOW "=== Ship Captain ===" RESET " I'm currently sailing, the signal cannot be made.\n");
+        signalSemaphore(semid, SEM_MUTEX);
+        return 0;
+    } else if (sm->queueDirection != 1) {
+        earlyVoyage = 1;
+        sm->queueDirection = 1;
+        if (!sm->twoLaneBridge) {
+            sm->shipSailing = 1; // Two lanes: passengers may still be leaving, preparation sets it
         }
-    } else if (sig == SIGUSR2) {
-        sendStopSignal();
+        signalSemaphore(semid, SEM_MUTEX);
+    } else {
+        // Disembarking, the ship leaves as soon as the next loading starts
+        signalSemaphore(semid, SEM_MUTEX);
+        earlyVoyage = 1;
+    }
+    return 1;
+}
+
 
+void startEndOfDay() {
+/*
+  * Ends the day, on SIGUSR2 or the "end" command: at once in port, after arrival when sailing.
+*/
+
+    live->endOfDayEvents++;
+    sendStopSignal();
+
+    waitSemaphore(semid, SEM_MUTEX);
+    int shipSailing = sm->shipSailing && loaded;
+    signalSemaphore(semid, SEM_MUTEX);
+
+    if (!shipSailing) {
         waitSemaphore(semid, SEM_MUTEX);
-        int shipSailing = sm->shipSailing && loaded;
+        sm->queueDirection = 1;
+        sm->signalEndOfDay = 1;
         signalSemaphore(semid, SEM_MUTEX);
+        setBoardingGate(semid, 1); // Passengers asleep at the gate have to see the end of the day
+    } else {
+        endOfDaySignal = 1;
+    }
+}
+
+
+void processControlCommands() {
+/*
+  * Carries out the commands waiting on the control socket and acknowledges each one
+  * once it has taken effect:
+  *   depart             early departure, refused while sailing
+  *   end                end of day
+  *   status             phase, voyage, people on ship and bridge, queue depth, boarded, departure policy,
+  *                      registered passengers and how many of them wait ashore or hold a reservation
+  *   policy <policy>    switch the departure policy, from the current loading window on
+*/
+
+    char command[CONTROL_LINE_LENGTH], details[CONTROL_LINE_LENGTH];
+    int client;
 
-        if (!shipSailing) {
+    while (nextControlCommand(control, &client, command, sizeof(command))) {
+        if (strcmp(command, "depart") == 0) {
+            int accepted = startEarlyDeparture();
+            replyControl(control, client, accepted, accepted ? "early departure" : "sailing");
+            if (accepted) {
+                EndOfDayOrEarlyVoyage();
+            }
+        } else if (strcmp(command, "end") == 0) {
+            startEndOfDay();
+            replyControl(control, client, 1, "end of day");
+            EndOfDayOrEarlyVoyage();
+        } else if (strcmp(command, "status") == 0) {
+            static const char *phaseNames[] = PHASE_NAMES;
+            int census[REGISTRY_STATES];
+            int registered = registryCensus(registry, census);
             waitSemaphore(semid, SEM_MUTEX);
-            sm->queueDirection = 1;
-            sm->signalEndOfDay = 1;
+            snprintf(details, sizeof(details), "phase=%s voyage=%d ship=%d bridge=%d queue=%d boarded=%lld policy=%s registered=%d ashore=%d reserved=%d",
+                     phaseNames[live->phase], sm->currentVoyage + 1, sm->peopleOnShip, sm->peopleOnBridge + sm->peopleOnBridgeInbound,
+                     live->queueDepth, live->boardedTotal, departurePolicy->name, registered, census[REGISTRY_ASHORE], census[REGISTRY_RESERVATION]);
             signalSemaphore(semid, SEM_MUTEX);
+            replyControl(control, client, 1, details);
+        } else if (strncmp(command, "policy ", 7) == 0) {
+            DeparturePolicy *policy = selectDeparturePolicy(command + 7);
+            if (policy == NULL) {
+                replyControl(control, client, 0, "unknown departure policy");
+                continue;
+            }
+            departurePolicy = policy;
+            departurePolicy->startWindow(departurePolicy);
+            printf(YELLOW "=== Ship Captain ===" RESET " Departure policy changed to %s.\n", departurePolicy->name);
+            snprintf(details, sizeof(details), "policy=%s", departurePolicy->name);
+            replyControl(control, client, 1, details);
         } else {
-            endOfDaySignal = 1;
+            replyControl(control, client, 0, "unknown command");
         }
     }
-
-    EndOfDayOrEarlyVoyage();
 }
 
 
@@ -522,28 +1339,111 @@ void sendStopSignal() {
 }
 
 
+void updateSchedulingStats() {
+/*
+  * Publishes how long the captain has waited for a CPU while runnable, from /proc/self/schedstat
+  * (time on CPU, time waiting on a run queue, number of timeslices).
+*/
+
+    FILE *schedstat = fopen("/proc/self/schedstat", "r");
+    if (schedstat == NULL) return;
+
+    long long onCpuNs, runDelayNs, timeslices;
+    if (fscanf(schedstat, "%lld %lld %lld", &onCpuNs, &runDelayNs, &timeslices) == 3) {
+        live->captainRunDelayNs = runDelayNs;
+        live->captainTimeslices = timeslices;
+    }
+    fclose(schedstat);
+}
+
+
+void printDepartureSummary() {
+/*
+  * Prints what the departure policy achieved today: passengers moved per second,
+  * mean load factor per voyage and mean passenger wait (bridge entry -> boarding).
+*/
+
+    double daySeconds = (getMonotonicTimeNs() - dayStartNs) / 1e9;
+    long long boarded = 0, waitNs = 0;
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        boarded += stats.classStats[c].boarded;
+        waitNs += stats.classStats[c].totalLatencyNs;
+    }
+
+    printf(YELLOW "=== Ship Captain ===" RESET " Departure policy %s: %lld passengers in %.1f s (%.2f/s), mean load factor %.2f, mean wait %.1f ms\n",
+           departurePolicy->name, live->boardedTotal, daySeconds, live->boardedTotal / daySeconds,
+           live->voyagesCompleted > 0 ? (double)live->boardedTotal / live->voyagesCompleted / SHIP_CAPACITY : 0,
+           boarded > 0 ? waitNs / 1e6 / boarded : 0);
+    if (live->voyagesCompleted > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Wasted bridge round trips: %lld, %.1f per voyage, early bridge closure %s\n",
+               live->wastedBridgeTrips, (double)live->wastedBridgeTrips / live->voyagesCompleted, BRIDGE_EARLY_CLOSURE ? "on" : "off");
+    }
+    if (live->loadingWindowsNs > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Loading throughput: %.1f boardings per second of loading over %d gangway%s (%s order), boarded per gangway:",
+               live->boardedTotal / (live->loadingWindowsNs / 1e9), sm->gangways, sm->gangways > 1 ? "s" : "",
+               sm->gangwayOrder == GANGWAY_ORDER_GANGWAY ? "per-gangway" : "global");
+        for (int g = 0; g < sm->gangways; g++) {
+            printf(" %lld", live->boardedOnGangway[g]);
+        }
+        printf("\n");
+    }
+    if (live->requestsReceived > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Bridge requests over the %s: %lld, %.1f/s, mean queueing delay %.1f us, %.3f syscalls per request\n",
+               requestRing != NULL ? "shared-memory ring" : "SysV queue", live->requestsReceived, live->requestsReceived / daySeconds,
+               live->requestDelayNs / 1e3 / live->requestsReceived, (double)live->requestSyscalls / live->requestsReceived);
+    }
+    if (live->passengersReclaimed > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Places reclaimed from passengers that died: %lld, their late requests ignored: %lld\n",
+               live->passengersReclaimed, live->staleRequests);
+    }
+    if (live->dockIdles > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Mean dock idle time (ready -> first boarding): %.1f ms over %lld voyages, %lld tickets taken ashore, pre-ticketing %s\n",
+               live->dockIdleNs / 1e6 / live->dockIdles, live->dockIdles, live->ticketsIssued, PRE_TICKETING ? "on" : "off");
+    }
+    if (live->turnarounds > 0) {
+        printf(YELLOW "=== Ship Captain ===" RESET " Mean dock turnaround (arrival -> departure): %.1f ms over %lld voyages, %s bridge\n",
+               live->turnaroundsNs / 1e6 / live->turnarounds, live->turnarounds, sm->twoLaneBridge ? "two-lane" : "single-lane");
+    }
+}
+
+
 void cleanupAndExit() {
 // Cleans up shared resources and exits the process.
 
-    shmdt(sm);
+    updateSchedulingStats();
+    live->phase = PHASE_FINISHED;
+    printClassStats();
+    printDepartureSummary();
+
+    closeSailedVoyage();
+    if (ledgerFd != -1) close(ledgerFd);
+    // signalEndOfDay is set: ticket requests sent before it are refused here, none come after it
+    while (receiveBridgeRequests(0) > 0);
+    dismissReservations();
+    setBoardingGate(semid, 1); // signalEndOfDay is set, nobody may stay asleep at the gate
+
+    // The day is over, the next start is a cold one
+    closeCheckpoint(checkpoint);
+    removeCheckpoint(CHECKPOINT_PATH);
+    closeControlServer(control, CONTROL_SOCKET_PATH);
+
+    detachSharedMemory();
     exit(0);
 }
 
 
 void dumpPassengersFromWaitingArray() {
 /*
-  * Removes all passengers from the waiting array by denying boarding.
+  * Removes all passengers from the waiting arrays by denying boarding.
 */
 
-    for (int y = 0; y < globalSequenceCounter; y++) {
-        pid_t pid = waitingArray[y];
-        if (pid != 0) {
-            BridgeMsg den;
-            den.mtype = pid;
-            den.pid = pid;
-            den.sequence = -1; // denied
-            msgsnd(msq_id, &den, sizeof(den) - sizeof(long), 0);
-            waitingArray[y] = 0;
-        }
-    }
+    BoardingEvent event = {0};
+    BoardingAction actions[BOARDING_BATCH];
+    int count;
+
+    event.type = BOARDING_EVENT_DRAIN;
+    do {
+        count = boardingStep(boarding, &event, NULL, actions, BOARDING_BATCH);
+        performBoardingActions(actions, count, 0);
+    } while (count == BOARDING_BATCH);
 }
\ No newline at end of file
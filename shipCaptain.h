@@ -1,16 +1,43 @@
 void initializeMessageQueue();
 void setupSignalHandlers();
-void sendPID();
 void cleanupAndExit();
+void updateSchedulingStats();
 void EndOfDayOrEarlyVoyage();
 void handleBridgeQueue();
+int receiveBridgeRequests(long waitUs);
+void handleBridgeMessage(const BridgeMsg *msg);
 void checkAndBoardNextInQueue();
+void loadShipView(ShipView *ship);
+void storeShipView(const ShipView *ship);
+void performBoardingActions(const BoardingAction *actions, int count, int currentVoyage);
+void replyToPassenger(BridgeMsg *reply, const char *what);
+pid_t passengerPid(int slot);
+void recordBoardingLatency(int passengerClass, long long latency);
+void recordBoardingRetries(int retries, int fromReservation);
+void denyBoarding(int slot, int passengerClass, int retries);
+void issueTicket(const BridgeMsg *msg);
+void boardReservedPassengers();
+void dismissReservations();
+void reclaimDeadPassengers();
+void dropReservations(int slot);
+void restoreCheckpoint();
+void saveCheckpoint();
+void closeVoyageClassStats();
+void printClassStats();
+void printDepartureSummary();
 void performCruiseOperations();
+int updateBridgeAdmission(int openSeats);
 void startCruisePreparation();
+void openVoyageRecord();
+void closeSailedVoyage();
 void performVoyage();
 void performDisembarkation();
 void waitForAllPassengersToDisembark();
 void getReadyForNextCruise();
 void sendStopSignal();
 void handle_signal(int sig);
+void processPendingSignals();
+int startEarlyDeparture();
+void startEndOfDay();
+void processControlCommands();
 void dumpPassengersFromWaitingArray();
\ No newline at end of file
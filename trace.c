@@ -0,0 +1,187 @@
+#include "trace.h"
+#include "utils.h"
+#include <dirent.h>
+
+/*
+ * Timeline tracing in Chrome trace-event format (also opened by Perfetto).
+ * Every process records begin/end events into its own private buffer, so recording
+ * needs no locks and no system calls. At exit the buffer is written to TRACE_DIR/<pid>.json
+ * and rejs merges all of them into one trace with a lane per process.
+*/
+
+typedef struct {
+    long long timestampNs;
+    char phase; // 'B' or 'E'
+    char name[TRACE_NAME_LENGTH];
+} TraceEvent;
+
+static TraceEvent *events = NULL; // NULL = tracing disabled
+static int eventCount = 0, droppedEvents = 0, depth = 0;
+static int skippedDepth = 0; // Spans opened but not recorded, their traceEnd() records nothing
+static char processLabel[64];
+static int processSortIndex;
+
+
+static void recordEvent(char phase, const char *name) {
+    if (eventCount >= TRACE_MAX_EVENTS) {
+        droppedEvents++;
+        return;
+    }
+    TraceEvent *event = &events[eventCount++];
+    event->timestampNs = getMonotonicTimeNs();
+    event->phase = phase;
+    snprintf(event->name, sizeof(event->name), "%s", name);
+}
+
+
+static void traceFlush() {
+/*
+  * Closes spans still open and writes this process's events to its trace file.
+  * Registered with atexit(), so every normal exit path of a process is covered.
+*/
+
+    droppedEvents += skippedDepth;
+    skippedDepth = 0;
+    while (depth > 0) {
+        traceEnd();
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), TRACE_DIR "/%d.json", getpid());
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(YELLOW "fopen trace" RESET);
+        return;
+    }
+
+    int pid = getpid();
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", pid, pid, processLabel);
+    fprintf(file, "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}},\n", pid, pid, processSortIndex);
+    for (int i = 0; i < eventCount; i++) {
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d},\n",
+                events[i].name, events[i].phase, events[i].timestampNs / 1e3, pid, pid);
+    }
+    if (droppedEvents > 0) {
+        fprintf(file, "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,\"args\":{\"count\":%d}},\n",
+                getMonotonicTimeNs() / 1e3, pid, pid, droppedEvents);
+    }
+    fclose(file);
+}
+
+
+void traceInit(const char *processName, int sortIndex) {
+/*
+  * Enables tracing for this process if TRACE_ENV is set.
+  *
+  * @param processName Label of the process lane in the trace.
+  * @param sortIndex Lanes are ordered by this index (captain first, passengers last).
+*/
+
+    if (getenv(TRACE_ENV) == NULL) {
+        return;
+    }
+
+    events = malloc(TRACE_MAX_EVENTS * sizeof(TraceEvent));
+    if (events == NULL) {
+        perror(YELLOW "malloc trace buffer" RESET);
+        return;
+    }
+
+    snprintf(processLabel, sizeof(processLabel), "%s %d", processName, getpid());
+    processSortIndex = sortIndex;
+    atexit(traceFlush);
+}
+
+
+void traceBegin(const char *name) {
+/*
+  * Opens a span on this process's lane. The span is not recorded if it is nested deeper than
+  * TRACE_MAX_DEPTH, inside a span that was not recorded, or if the buffer lacks room for its
+  * begin and the ends of every open span including its own, so every recorded span is closed.
+*/
+
+    if (events == NULL) {
+        return;
+    }
+    if (skippedDepth > 0 || depth >= TRACE_MAX_DEPTH || eventCount + depth + 2 > TRACE_MAX_EVENTS) {
+        skippedDepth++;
+        droppedEvents++;
+        return;
+    }
+    depth++;
+    recordEvent('B', name);
+}
+
+
+void traceEnd() {
+// Closes the innermost open span.
+
+    if (events == NULL) {
+        return;
+    }
+    if (skippedDepth > 0) {
+        skippedDepth--;
+        droppedEvents++;
+        return;
+    }
+    if (depth == 0) {
+        return;
+    }
+    depth--;
+    recordEvent('E', "");
+}
+
+
+int traceMerge() {
+/*
+  * Merges the per-process trace files into one JSON trace at the path given in TRACE_ENV
+  * and removes them.
+  *
+  * @return Number of processes merged, -1 if tracing is disabled or failed.
+*/
+
+    const char *outputPath = getenv(TRACE_ENV);
+    if (outputPath == NULL) {
+        return -1;
+    }
+
+    DIR *dir = opendir(TRACE_DIR);
+    if (dir == NULL) {
+        perror(YELLOW "opendir trace" RESET);
+        return -1;
+    }
+
+    FILE *output = fopen(outputPath, "w");
+    if (output == NULL) {
+        perror(YELLOW "fopen merged trace" RESET);
+        closedir(dir);
+        return -1;
+    }
+
+    fprintf(output, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    int merged = 0;
+    char path[512], line[256];
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+
+        snprintf(path, sizeof(path), TRACE_DIR "/%s", entry->d_name);
+        FILE *input = fopen(path, "r");
+        if (input == NULL) continue;
+
+        while (fgets(line, sizeof(line), input) != NULL) {
+            fputs(line, output);
+        }
+        fclose(input);
+        unlink(path);
+        merged++;
+    }
+    closedir(dir);
+    rmdir(TRACE_DIR);
+
+    // Closing element, so every merged event can keep its trailing comma
+    fprintf(output, "{\"name\":\"end\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{}}\n]}\n");
+    fclose(output);
+    return merged;
+}
@@ -0,0 +1,15 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_ENV "REJS_TRACE" // Set to the output path of the merged trace to enable tracing
+#define TRACE_DIR "/tmp/rejs-trace" // Per-process trace files, merged by rejs at exit
+#define TRACE_MAX_EVENTS 8192 // Per process, later events are dropped
+#define TRACE_MAX_DEPTH 8
+#define TRACE_NAME_LENGTH 24
+
+void traceInit(const char *processName, int sortIndex);
+void traceBegin(const char *name);
+void traceEnd();
+int traceMerge();
+
+#endif
@@ -1,9 +1,17 @@
+#define _GNU_SOURCE
 #include "utils.h"
+#include "shared_region.h"
+#include "bridge_queue.h"
+#include "request_ring.h"
+#include "registry.h"
+
+static RegionHeader *attachedRegion = NULL; // Region mapped by attachSharedMemory()
 
 void waitSemaphore(int semID, int number) {
 /*
   * Waits for a semaphore to become available by decrementing its value.
   * If the semaphore value is already zero, the process blocks until it becomes available.
+  * With SEM_UNDO, so the kernel gives it back if the process dies holding it.
   *
   * @param semID The ID of the semaphore set.
   * @param number The index of the semaphore in the set to decrement.
@@ -11,7 +19,7 @@ void waitSemaphore(int semID, int number) {
     struct sembuf operation;
     operation.sem_num = number;
     operation.sem_op = -1;   
-    operation.sem_flg = 0;
+    operation.sem_flg = SEM_UNDO;
 
     while (semop(semID, &operation, 1) == -1) {
         if (errno == EINTR) {
@@ -35,7 +43,7 @@ void signalSemaphore(int semID, int number) {
    struct sembuf operation;
    operation.sem_num = number;
    operation.sem_op = 1;
-   operation.sem_flg = 0;
+   operation.sem_flg = SEM_UNDO;
 
     while (semop(semID, &operation, 1) == -1) {
         if (errno == EINTR) {
@@ -47,6 +55,172 @@ void signalSemaphore(int semID, int number) {
     }
 }
 
+static void operateTokenAndMutex(int semID, int token, int op, const char *what) {
+    // Moves one bridge token and SEM_MUTEX in one atomic semop, only SEM_MUTEX with SEM_UNDO
+    struct sembuf operations[2] = {{token, op, 0}, {SEM_MUTEX, op, SEM_UNDO}};
+
+    while (semop(semID, operations, 2) == -1) {
+        if (errno != EINTR) {
+            perror(what);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+void waitTokenAndMutex(int semID, int token) {
+/*
+  * Takes a place on a bridge lane (a gangway or SEM_BRIDGE_INBOUND) together with SEM_MUTEX.
+  * A passenger holds a bridge token exactly while its registry state counts it on that lane,
+  * and both only change with SEM_MUTEX held, so a passenger that dies never holds a token the
+  * registry does not show. The token is not undone by the kernel: the ship captain gives it
+  * back together with the count when it reclaims a dead passenger's place.
+  *
+  * @param token SEM_GANGWAY(g) or SEM_BRIDGE_INBOUND.
+*/
+
+    operateTokenAndMutex(semID, token, -1, "waitTokenAndMutex");
+}
+
+
+void signalTokenAndMutex(int semID, int token) {
+/*
+  * Gives back a place on a bridge lane and SEM_MUTEX at once, see waitTokenAndMutex().
+*/
+
+    operateTokenAndMutex(semID, token, 1, RED "signalTokenAndMutex" RESET);
+}
+
+
+void returnTokens(int semID, int token, int count) {
+/*
+  * Gives back bridge tokens on behalf of passengers: those the captain boards or reclaims.
+  * Called with SEM_MUTEX held, in the critical section that takes them off the lane's count.
+*/
+
+    struct sembuf operation = {token, count, 0};
+    while (semop(semID, &operation, 1) == -1) {
+        if (errno != EINTR) {
+            perror(RED "returnTokens" RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
+int passBoardingGate(int semID, int token, int recheckMs) {
+/*
+  * Waits for the boarding gate to be open and takes a place on a gangway together with SEM_MUTEX,
+  * all in one atomic semop. While the ship captain keeps the gate closed the caller sleeps in the
+  * kernel instead of taking both semaphores only to find boarding closed. The token is held as
+  * with waitTokenAndMutex(); the gate is only waited for, never taken.
+  *
+  * @param token SEM_GANGWAY(g).
+  * @param recheckMs If not 0, wakes up this often and gives up once the gate is closed, so a caller
+  *                  that fell asleep while boarding was open can take a ticket instead.
+  * @return 1 if the token and SEM_MUTEX are held, 0 if it gave up.
+*/
+
+#if BOARDING_GATE
+    struct sembuf operations[3] = {{SEM_BOARDING_GATE, 0, 0}, {token, -1, 0}, {SEM_MUTEX, -1, SEM_UNDO}};
+    struct timespec timeout = {recheckMs / 1000, (recheckMs % 1000) * 1000000L};
+
+    while (semtimedop(semID, operations, 3, recheckMs > 0 ? &timeout : NULL) == -1) {
+        if (errno == EAGAIN && boardingGateClosed(semID)) {
+            return 0;
+        } else if (errno != EINTR && errno != EAGAIN) {
+            perror("passBoardingGate");
+            exit(EXIT_FAILURE);
+        }
+    }
+#else
+    (void)recheckMs;
+    waitTokenAndMutex(semID, token);
+#endif
+    return 1;
+}
+
+
+void waitBoardingGateOpen(int semID) {
+/*
+  * Sleeps until the boarding gate is open, without taking anything. Returns at once if it is.
+*/
+
+#if BOARDING_GATE
+    struct sembuf operation = {SEM_BOARDING_GATE, 0, 0};
+
+    while (semop(semID, &operation, 1) == -1) {
+        if (errno != EINTR) {
+            perror("waitBoardingGateOpen");
+            exit(EXIT_FAILURE);
+        }
+    }
+#else
+    (void)semID;
+#endif
+}
+
+
+void setBoardingGate(int semID, int open) {
+/*
+  * Opens or closes the boarding gate. Ship captain only; setting it twice is harmless.
+  * Opening it wakes every passenger sleeping in passBoardingGate(), and those that find
+  * no room on their gangway go back to sleep in the same semop.
+  *
+  * @param open 1 = boarding open, 0 = closed.
+*/
+
+#if BOARDING_GATE
+    if (semctl(semID, SEM_BOARDING_GATE, SETVAL, open ? 0 : 1) == -1) {
+        perror(RED "semctl SETVAL boarding gate" RESET);
+        exit(EXIT_FAILURE);
+    }
+#else
+    (void)semID;
+    (void)open;
+#endif
+}
+
+
+int boardingGateClosed(int semID) {
+/*
+  * @return 1 if the ship captain has closed the boarding gate.
+*/
+
+#if BOARDING_GATE
+    int closed = semctl(semID, SEM_BOARDING_GATE, GETVAL);
+    if (closed == -1) {
+        perror("semctl GETVAL boarding gate");
+        exit(EXIT_FAILURE);
+    }
+    return closed;
+#else
+    (void)semID;
+    return 0;
+#endif
+}
+
+
+void reportReady(SharedMemory *shared, int semID, int role) {
+/*
+  * Tells rejs that a role has finished starting up: its time first, then one unit of SEM_READY,
+  * so rejs sees the time once it has taken the unit.
+  *
+  * @param role ROLE_*.
+*/
+
+    shared->readyAtNs[role] = getMonotonicTimeNs();
+
+    struct sembuf operation = {SEM_READY, 1, 0};
+    while (semop(semID, &operation, 1) == -1) {
+        if (errno != EINTR) {
+            perror(RED "reportReady" RESET);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+
 int initializeSemaphores() {
 /*
   * Initializes a set of semaphores for mutual exclusion and bridge control.
@@ -60,15 +234,20 @@ int initializeSemaphores() {
         exit(EXIT_FAILURE);
     }
 
-    int semid = semget(semKey, 2, IPC_CREAT | IPC_EXCL | 0600);
+    int semid = semget(semKey, SEM_COUNT, IPC_CREAT | IPC_EXCL | 0600);
     if (semid == -1) {
         perror(RED "semget" RESET);
         exit(EXIT_FAILURE);
     }
 
-    unsigned short initValues[2];
+    unsigned short initValues[SEM_COUNT];
     initValues[SEM_MUTEX] = 1;
-    initValues[SEM_BRIDGE] = BRIDGE_CAPACITY;
+    initValues[SEM_BRIDGE_INBOUND] = BRIDGE_INBOUND_CAPACITY;
+    for (int g = 0; g < MAX_GANGWAYS; g++) {
+        initValues[SEM_GANGWAY(g)] = BRIDGE_CAPACITY; // Gangways rejs -G leaves unused are never taken
+    }
+    initValues[SEM_BOARDING_GATE] = 0; // The day starts with boarding open
+    initValues[SEM_READY] = 0;
 
     if (semctl(semid, 0, SETALL, initValues) == -1) {
         perror(RED "semctl SETALL" RESET);
@@ -94,40 +273,60 @@ void cleanupSemaphores(int semid) {
     }
 }
 
+void removeLeftoverResources() {
+/*
+  * Removes what a simulation killed before its own cleanup leaves behind: the semaphore set,
+  * the bridge message queue, the FIFOs, the control socket, the region info file and the checkpoint, so the next
+  * run starts cold instead of failing on semget or continuing the killed day.
+*/
+
+    key_t semKey = ftok(".", SEM_PROJECT_ID);
+    int semid = semKey == -1 ? -1 : semget(semKey, 0, 0);
+    if (semid != -1) semctl(semid, 0, IPC_RMID);
+
+    int msqid = msgget(BRIDGE_QUEUE_KEY, 0);
+    if (msqid != -1) msgctl(msqid, IPC_RMID, NULL);
+
+    unlink(CONTROL_SOCKET_PATH);
+    unlink(FIFO_PATH_PASSENGERS);
+    unlink(REGION_INFO_PATH);
+    unlink(CHECKPOINT_PATH);
+}
+
 int initializeSharedMemory() {
 /*
-  * Initializes a shared memory segment to hold shared data between processes.
+  * Creates the shared region holding data shared between processes
+  * and carves the SharedMemory, LiveStats, request ring, reply ring and passenger registry sections out of it.
   *
-  * @return The ID of the created shared memory segment.
+  * @return The file descriptor of the region, inherited by child processes.
 */
 
-    key_t memoryKey = ftok(".", SHM_PROJECT_ID);
-    if (memoryKey == -1) {
-        perror(RED "ftok for shm" RESET);
-        exit(EXIT_FAILURE);
-    }
+    int regionFd = createSharedRegion(SHARED_REGION_SIZE, SHARED_REGION_HUGE_PAGES);
 
-    int shmid = shmget(memoryKey, sizeof(SharedMemory), IPC_CREAT | IPC_EXCL | 0600);
-    if (shmid == -1) {
-        perror(RED "shmget" RESET);
-        exit(EXIT_FAILURE);
-    }
+    RegionHeader *region = mapSharedRegion(regionFd);
+    addRegionSection(region, SECTION_SHARED_MEMORY, sizeof(SharedMemory));
+    addRegionSection(region, SECTION_LIVE_STATS, sizeof(LiveStats));
+    addRegionSection(region, SECTION_REQUEST_RING, sizeof(RequestRing));
+    addRegionSection(region, SECTION_REPLY_RING, sizeof(RequestRing));
+    addRegionSection(region, SECTION_REGISTRY, sizeof(PassengerRegistry));
+    unmapSharedRegion(region);
 
-    printf(GREEN "Shared memory segment created successfully." RESET "\n");
-    return shmid;
+    printf(GREEN "Shared memory region created successfully." RESET "\n");
+    return regionFd;
 }
 
-void cleanupSharedMemory(int shmid) {
+void cleanupSharedMemory(int regionFd) {
 /*
-  * Cleans up and removes a shared memory segment.
+  * Closes the creator's descriptor of the shared region.
+  * The region is freed once the last process holding it has exited.
   *
-  * @param shmid The ID of the shared memory segment to remove.
+  * @param regionFd The file descriptor of the shared region.
 */
 
-    if (shmctl(shmid, IPC_RMID, NULL) == -1) {
-        perror(RED "shmctl" RESET);
+    if (close(regionFd) == -1) {
+        perror(RED "close region" RESET);
     } else {
-        printf(GREEN "Shared memory segment cleaned up successfully." RESET "\n");
+        printf(GREEN "Shared memory region cleaned up successfully." RESET "\n");
     }
 }
 
@@ -172,21 +371,160 @@ void handleInput() {
         exit(7);
     }
 
+    int reserved[] = CLASS_RESERVED_SEATS;
+    int weights[] = CLASS_WEIGHTS;
+    int shares[] = CLASS_SHARE_PERCENT;
+    int reservedTotal = 0, shareTotal = 0;
+    for (int c = 0; c < NUM_PASSENGER_CLASSES; c++) {
+        if (reserved[c] < 0 || weights[c] < 1 || shares[c] < 0) {
+            fprintf(stderr, RED "Class %d: reserved seats and share cannot be negative, weight must be at least 1." RESET "\n", c);
+            exit(8);
+        }
+        reservedTotal += reserved[c];
+        shareTotal += shares[c];
+    }
+
+    if (reservedTotal > SHIP_CAPACITY) {
+        fprintf(stderr, RED "The reserved seats of all classes cannot exceed the ship capacity." RESET "\n");
+        exit(9);
+    }
+
+    if (shareTotal != 100) {
+        fprintf(stderr, RED "The class shares of generated passengers must add up to 100." RESET "\n");
+        exit(10);
+    }
+
+    if (BRIDGE_INBOUND_CAPACITY < 1 || BRIDGE_INBOUND_CAPACITY >= SHIP_CAPACITY) {
+        fprintf(stderr, RED "The capacity of the lane towards land must be between 1 and the ship capacity - 1." RESET "\n");
+        exit(11);
+    }
+
     printf(GREEN "All parameters have been correctly defined." RESET "\n");
 }
 
-SharedMemory* attachSharedMemory(int shmid) {
+SharedMemory* attachSharedMemory(int regionFd) {
 /*
-  * Attaches a shared memory segment to the process's address space.
+  * Maps the shared region into the process's address space.
   *
-  * @param shmid The ID of the shared memory segment to attach.
-  * @return A pointer to the attached shared memory segment.
+  * @param regionFd The file descriptor of the shared region.
+  * @return A pointer to the SharedMemory section of the region.
 */
 
-    SharedMemory* sm = (SharedMemory *)shmat(shmid, NULL, 0);
-    if (sm == (void *)-1) {
-        perror(RED "shmat" RESET);
+    attachedRegion = mapSharedRegion(regionFd);
+
+    SharedMemory* sm = findRegionSection(attachedRegion, SECTION_SHARED_MEMORY);
+    if (sm == NULL) {
+        fprintf(stderr, RED "Shared region has no '%s' section." RESET "\n", SECTION_SHARED_MEMORY);
         exit(EXIT_FAILURE);
     }
     return sm;
-}
\ No newline at end of file
+}
+
+
+void* attachSharedSection(const char *name) {
+/*
+  * Looks up a section of the shared region mapped by attachSharedMemory().
+  *
+  * @param name The name of the section.
+  * @return A pointer to the section.
+*/
+
+    void *section = findRegionSection(attachedRegion, name);
+    if (section == NULL) {
+        fprintf(stderr, RED "Shared region has no '%s' section." RESET "\n", name);
+        exit(EXIT_FAILURE);
+    }
+    return section;
+}
+
+
+const void* attachPublishedRegionReadOnly() {
+/*
+  * Maps, read-only, the shared region of the simulation currently running,
+  * found through REGION_INFO_PATH. Used by observers that are not started by rejs.
+  *
+  * @return A pointer to the region header (const RegionHeader *).
+*/
+
+    FILE *info = fopen(REGION_INFO_PATH, "r");
+    if (info == NULL) {
+        perror(RED "No running simulation (" REGION_INFO_PATH ")" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    int ownerPid, ownerFd;
+    if (fscanf(info, "%d %d", &ownerPid, &ownerFd) != 2) {
+        fprintf(stderr, RED "Malformed " REGION_INFO_PATH RESET "\n");
+        exit(EXIT_FAILURE);
+    }
+    fclose(info);
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd/%d", ownerPid, ownerFd);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror(RED "open shared region" RESET);
+        exit(EXIT_FAILURE);
+    }
+
+    const RegionHeader *region = mapSharedRegionReadOnly(fd);
+    close(fd);
+    return region;
+}
+
+
+void detachSharedMemory() {
+// Unmaps the shared region mapped by attachSharedMemory().
+
+    if (attachedRegion != NULL) {
+        unmapSharedRegion(attachedRegion);
+        attachedRegion = NULL;
+    }
+}
+
+
+long long getMonotonicTimeNs() {
+/*
+  * Reads the monotonic clock, unaffected by wall-clock adjustments.
+  *
+  * @return Current CLOCK_MONOTONIC time in nanoseconds.
+*/
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+long long getRealTimeNs() {
+/*
+  * Reads the wall clock, for timestamps compared across runs.
+  *
+  * @return Current CLOCK_REALTIME time in nanoseconds since the epoch.
+*/
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+long long latencyPercentileUs(const volatile long long buckets[], double percentile) {
+/*
+  * Reads a percentile off a LATENCY_BUCKETS histogram.
+  *
+  * @param percentile Between 0 and 100.
+  * @return Upper bound of the bucket holding the percentile [us], 0 if the histogram is empty.
+*/
+
+    long long total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) total += buckets[i];
+    if (total == 0) return 0;
+
+    long long rank = (long long)(total * percentile / 100.0 + 0.999999), seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) return 1LL << i;
+    }
+    return 1LL << (LATENCY_BUCKETS - 1);
+}
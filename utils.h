@@ -18,6 +18,7 @@
 #include <sys/msg.h>
 #include <sys/ipc.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 
 
 #define RED "\033[31m"
@@ -27,40 +28,191 @@
 #define CYAN "\033[36m"
 #define RESET "\033[0m"
 
-#define FIFO_PATH "/tmp/shipCaptainPID"
 #define FIFO_PATH_PASSENGERS "/tmp/passengers"
+#define CHECKPOINT_PATH "/tmp/rejs.ckpt"
+#define LEDGER_PATH "/tmp/rejs.ledger" // One record per voyage, appended across runs, see ledger.h
+#define REGION_INFO_PATH "/tmp/rejs.region" // "<rejs PID> <region fd>", lets monitors find the shared region
+#define CONTROL_SOCKET_PATH "/tmp/rejs-control.sock" // Ship captain's control plane, see control.h
+#define METRICS_SOCKET_PATH "/tmp/rejs-metrics.sock"
+#define VIOLATIONS_LOG_PATH "/tmp/rejs-violations.log"
+#define RUN_REPORT_VERSION 2 // First line of the key=value run report of rejs -o
 
+// N and K can be overridden at build time, e.g. make DEFINES="-DSHIP_CAPACITY=50 -DBRIDGE_CAPACITY=5"
+#ifndef SHIP_CAPACITY
 #define SHIP_CAPACITY 25
+#endif
+#ifndef BRIDGE_CAPACITY
 #define BRIDGE_CAPACITY 10
+#endif
+#define BRIDGE_INBOUND_CAPACITY 10 // Lane towards land of the two-lane bridge (rejs -L)
+#define MAX_GANGWAYS 4 // Gangways towards the ship (rejs -G), BRIDGE_CAPACITY each
+#define GANGWAY_ORDER_GLOBAL 0  // One boarding order over all gangways
+#define GANGWAY_ORDER_GANGWAY 1 // Each gangway boards in its own order, nobody waits for another gangway
+#ifndef BRIDGE_EARLY_CLOSURE
+#define BRIDGE_EARLY_CLOSURE 1 // 1 = stop admitting to the bridge once the passengers on it can take every open seat
+#endif
+#ifndef PRE_TICKETING
+#define PRE_TICKETING 1 // 1 = passengers finding the ship away take a ticket for the next voyage instead of bouncing off the bridge
+#endif
+#ifndef BOARDING_GATE
+#define BOARDING_GATE 1 // 1 = passengers sleep at a gate the captain closes while boarding is closed, instead of polling the bridge
+#endif
+#define BOARDING_GATE_RECHECK_MS 100 // How often passengers asleep at the gate look whether it closed behind them, see passBoardingGate()
 #define TIME_BETWEEN_TRIPS 2 // [s]
 #define TRIP_DURATION 1 // [s]
 #define NUMBER_OF_TRIPS_PER_DAY 5
+#define LEASE_CHECK_MS 100 // How often the ship captain looks for passengers that died holding a place on the bridge or ship
 
-#define SHM_PROJECT_ID 'A'
+// Departure policies (rejs -D), see departure.c
+#define DEPARTURE_POLICY "fixed"      // Loads for TIME_BETWEEN_TRIPS
+#define DEPARTURE_MAX_WAIT_MS 4000    // Longest loading window of the adaptive policies
+#define DEPARTURE_TARGET_LOAD 0.8     // Load factor the "load" policy waits for
+#define DEPARTURE_RATE_SLOT_MS 100    // Arrival rate estimation slot of the "rate" policy
+
+// How passengers' bridge requests reach the ship captain (rejs -Q)
+#define REQUEST_TRANSPORT_SYSV 0 // SysV message queue, one msgrcv per request
+#define REQUEST_TRANSPORT_RING 1 // Lock-free ring in the shared region, see request_ring.c
+#define REQUEST_TRANSPORT REQUEST_TRANSPORT_RING
+
+// Passenger engine (rejs -E): every passenger is a state record in one passengerEngine process
+#define PASSENGER_ENGINE_ID_BASE 0x40000000 // Passenger ids of the engine's records, above any real PID
+
+// Boarding classes, highest priority first
+#define CLASS_CREW 0
+#define CLASS_REDUCED_MOBILITY 1
+#define CLASS_PRIORITY 2
+#define CLASS_STANDARD 3
+#define NUM_PASSENGER_CLASSES 4
+
+// Per-class settings, indexed by class
+#define CLASS_NAMES {"crew", "reduced-mobility", "priority", "standard"}
+#define CLASS_RESERVED_SEATS {1, 1, 2, 0}      // Seats nobody from another class may take
+#define CLASS_WEIGHTS {8, 6, 4, 1}             // Share of boarding turns when several classes are ready
+#define CLASS_LATENCY_SLA_MS {50, 100, 200, 0} // Bridge entry -> boarding, 0 = no SLA
+#define CLASS_SHARE_PERCENT {2, 3, 10, 85}     // Share of generated passengers
+
+#define SHARED_REGION_SIZE (1024 * 1024) // [B], header and all sections
+#define SHARED_REGION_HUGE_PAGES 0        // 1 = back the shared region with 2 MiB huge pages
+#define SECTION_SHARED_MEMORY "shared"
+#define SECTION_LIVE_STATS "live"
+#define SECTION_REQUEST_RING "requests"
+#define SECTION_REPLY_RING "replies" // Ship captain -> passenger engine
+#define SECTION_REGISTRY "registry"   // Passenger registry, see registry.c
 #define SEM_PROJECT_ID 'B'
 
 // Semaphore indices in the semaphore array
 #define SEM_MUTEX 0      // Semaphore for the critical section
 #define SEM_BRIDGE 1     // Semaphore controlling the number of people on the bridge
+#define SEM_BRIDGE_INBOUND 2 // Two-lane bridge: people on the lane towards land
+#define SEM_GANGWAY(g) ((g) == 0 ? SEM_BRIDGE : SEM_BRIDGE_INBOUND + (g)) // Gangway g, SEM_BRIDGE is the first one
+#define SEM_BOARDING_GATE (SEM_BRIDGE_INBOUND + MAX_GANGWAYS) // 0 = boarding open, 1 = closed, see passBoardingGate()
+#define SEM_READY (SEM_BOARDING_GATE + 1) // One unit per startup role that reported ready, see reportReady()
+#define SEM_COUNT (SEM_READY + 1)
+
+// Roles reporting ready at startup; rejs lets passengers arrive once the ship captain
+// (and the passenger engine, if any) has
+#define ROLE_SHIP_CAPTAIN 0
+#define ROLE_HARBOUR_CAPTAIN 1
+#define ROLE_PASSENGER_ENGINE 2
+#define STARTUP_ROLES 3
+#define STARTUP_ROLE_NAMES {"ship captain", "harbour captain", "passenger engine"}
+#define STARTUP_TIMEOUT_MS 5000 // Longest wait for the roles before passengers arrive anyway
 
 typedef struct {
     int peopleOnShip;
     int peopleOnBridge;
     int currentVoyage;  // Current number of completed voyages
     int signalEndOfDay; // Signal 2
-    int queueDirection; // 0 = towards ship, 1 = towards land
+    int queueDirection; // 0 = towards ship, 1 = towards land, 2 = towards ship for passengers with reservations only
     int shipSailing;    // 0 = in port, 1 = on cruise
+    int twoLaneBridge;  // 1 = disembarking uses its own lane and overlaps boarding (rejs -L)
+    int peopleOnBridgeInbound; // Two-lane bridge: people on the lane towards land
+    int peopleToDisembark;     // Passengers of the last voyage still on board
+    int requestTransport;      // REQUEST_TRANSPORT_*
+    int passengerEngine;       // 1 = passengers are records of the passenger engine (rejs -E)
+    int passengersArrived;     // Passenger engine: passengers rejs has let arrive so far
+    int gangways;              // Gangways towards the ship in use, 1..MAX_GANGWAYS
+    int gangwayOrder;          // GANGWAY_ORDER_*
+    int peopleOnGangway[MAX_GANGWAYS]; // Passengers on each gangway towards the ship, also counted in peopleOnBridge
+    long long launchedAtNs;             // rejs, just before it starts the roles
+    volatile long long readyAtNs[STARTUP_ROLES]; // When each role reported ready, 0 = not yet
 } SharedMemory;
 
+// Phases of the ship captain's cycle
+#define PHASE_STARTING 0
+#define PHASE_LOADING 1
+#define PHASE_PREPARATION 2       // Clearing the bridge before departure
+#define PHASE_VOYAGE 3
+#define PHASE_DISEMBARK 4
+#define PHASE_RESERVED_BOARDING 5 // Boarding passengers with carry-over reservations
+#define PHASE_FINISHED 6
+#define PHASE_NAMES {"starting", "loading", "preparation", "voyage", "disembark", "reserved boarding", "finished"}
+
+/*
+ * Counters published by the ship captain for monitoring.
+ * The captain is the only writer; readers never take SEM_MUTEX and may see
+ * values from slightly different moments.
+*/
+#define LATENCY_BUCKETS 32
+
+typedef struct {
+    volatile pid_t captainPid;
+    volatile int phase;
+    volatile int queueDepth;          // Sequences assigned but not yet boarded or denied
+    volatile int reservationsWaiting; // Passengers ashore holding a carry-over reservation
+    volatile long long boardedTotal;
+    volatile long long deniedTotal;
+    volatile long long captainLoops;  // Calls of handleBridgeQueue()
+    volatile long long voyagesCompleted;
+    volatile long long loadingWindows;
+    volatile long long loadingWindowsNs;  // Sum of loading window durations
+    volatile long long lastLoadingWindowNs;
+    volatile long long earlyDepartures;   // SIGUSR1 received
+    volatile long long endOfDayEvents;    // SIGUSR2 received
+    volatile long long requestsReceived;  // Bridge requests handled by the captain
+    volatile long long requestDelayNs;    // Sum of their send -> handled delays
+    volatile long long requestSyscalls;   // msgrcv calls, or futex sleeps on the request ring
+    volatile long long wastedBridgeTrips; // Walked onto the bridge and back without boarding
+    volatile long long turnarounds;       // Arrival -> next departure
+    volatile long long turnaroundsNs;
+    volatile long long lastTurnaroundNs;
+    volatile long long captainRunDelayNs; // Time the captain was runnable but waiting for a CPU
+    volatile long long captainTimeslices;
+    volatile long long passengersReclaimed; // Dead passengers whose place the captain took back
+    volatile long long staleRequests;       // Requests from dead passengers' slots, ignored
+    volatile long long ticketsIssued;       // Tickets for the next voyage taken ashore
+    volatile long long dockIdles;           // Ship ready to load -> first boarding
+    volatile long long dockIdleNs;
+    volatile long long lastDockIdleNs;
+    volatile long long boardedOnGangway[MAX_GANGWAYS];
+    volatile long long firstBoardingNs;     // The day's first boarding, 0 = nobody boarded yet
+    volatile long long boardingLatencyBuckets[LATENCY_BUCKETS]; // Bridge entry -> boarding, bucket i: below 2^i us
+} LiveStats;
+
 
 void handleInput();
-void launchHarbourCaptain(pid_t shipCaptainPID);
+void launchHarbourCaptain(int controlFd);
 int initializeSharedMemory();
 int initializeSemaphores();
 void cleanupSemaphores(int semid);
-void cleanupSharedMemory(int shmid);
+void removeLeftoverResources();
+void cleanupSharedMemory(int regionFd);
 void waitSemaphore(int semID, int number);
 void signalSemaphore(int semID, int number);
-SharedMemory* attachSharedMemory(int shmid);
+void waitTokenAndMutex(int semID, int token);
+void signalTokenAndMutex(int semID, int token);
+void returnTokens(int semID, int token, int count);
+void reportReady(SharedMemory *shared, int semID, int role);
+int passBoardingGate(int semID, int token, int recheckMs);
+void waitBoardingGateOpen(int semID);
+void setBoardingGate(int semID, int open);
+int boardingGateClosed(int semID);
+SharedMemory* attachSharedMemory(int regionFd);
+void detachSharedMemory();
+void* attachSharedSection(const char *name);
+const void* attachPublishedRegionReadOnly();
+long long getMonotonicTimeNs();
+long long getRealTimeNs();
+long long latencyPercentileUs(const volatile long long buckets[], double percentile);
 
 #endif 
\ No newline at end of file